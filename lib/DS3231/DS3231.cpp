@@ -37,6 +37,8 @@
 #define REG_DATE	0x04
 #define REG_MON		0x05
 #define REG_YEAR	0x06
+#define REG_ALARM1	0x07
+#define REG_ALARM2	0x0b
 #define REG_CON		0x0e
 #define REG_STATUS	0x0f
 #define REG_AGING	0x10
@@ -45,6 +47,23 @@
 
 #define SEC_1970_TO_2000 946684800
 
+// delay per half bit of the software I2C in us, on top of the pin access;
+// 2 gives roughly 80 kHz on a 16 MHz AVR
+#ifndef DS3231_SOFT_I2C_DELAY
+	#define DS3231_SOFT_I2C_DELAY 2
+#endif
+
+// half bit periods to wait for an ACK
+#ifndef DS3231_SOFT_I2C_ACK_TIMEOUT
+	#define DS3231_SOFT_I2C_ACK_TIMEOUT 100
+#endif
+
+#if DS3231_SOFT_I2C_DELAY > 0
+	#define DS3231_SOFT_I2C_WAIT() delayMicroseconds(DS3231_SOFT_I2C_DELAY)
+#else
+	#define DS3231_SOFT_I2C_WAIT()
+#endif
+
 static const uint8_t dim[] = { 31,28,31,30,31,30,31,31,30,31,30,31 };
 
 /* Public */
@@ -64,12 +83,19 @@ DS3231::DS3231(uint8_t data_pin, uint8_t sclk_pin)
 {
 	_sda_pin = data_pin;
 	_scl_pin = sclk_pin;
+	_cacheInterval = 0;
+	_cacheTicks = 0;
+	_cacheValid = false;
+	_cacheUseTicks = false;
+	_tempSampleNum = 0;
+	_tempSampleCount = 0;
+	_busErrors = 0;
 }
 
 Time DS3231::getTime()
 {
 	Time t;
-	_burstRead();
+	_readRegisters(REG_SEC, _burstArray, 7);
 	t.sec	= _decode(_burstArray[0]);
 	t.min	= _decode(_burstArray[1]);
 	t.hour	= _decodeH(_burstArray[2]);
@@ -80,13 +106,105 @@ Time DS3231::getTime()
 	return t;
 }
 
+// Time from the cache, extrapolated by millis() or by the SQW ticks passed
+// to tick(). The RTC is read again when the cache is older than the
+// interval or the hour would roll over, so date and day of week never
+// have to be calculated. Without an interval every call reads the RTC.
+// The age is also kept by millis() in tick mode: when the ticks fall
+// more than a second behind, the square wave has stopped (broken wire,
+// enableAlarm()), and the time goes on by millis() instead of freezing.
+Time DS3231::getCachedTime()
+{
+	unsigned long elapsed;
+	unsigned long age;
+
+	if (_cacheInterval == 0)
+		return getTime();
+
+	age = millis() - _cacheMillis;
+	if (_cacheUseTicks)
+	{
+		noInterrupts();
+		elapsed = _cacheTicks;
+		interrupts();
+		if (age / 1000 > elapsed + 1)
+			elapsed = age / 1000;
+	}
+	else
+		elapsed = age / 1000;
+
+	if ((!_cacheValid) || (age >= _cacheInterval) || (elapsed * 1000 >= _cacheInterval) ||
+		(_cacheTime.min * 60 + _cacheTime.sec + elapsed >= 3600))
+	{
+		// A tick during the read leaves open whether the read saw the new
+		// second, then read again. Ticks come a second apart, so the
+		// second read is clean.
+		for (uint8_t i = 0; i < 2; i++)
+		{
+			noInterrupts();
+			_cacheTicks = 0;
+			interrupts();
+			_cacheMillis = millis();
+			_cacheTime = getTime();
+			noInterrupts();
+			elapsed = _cacheTicks;
+			interrupts();
+			if ((!_cacheUseTicks) || (elapsed == 0))
+				break;
+		}
+		_cacheValid = true;
+		return _cacheTime;
+	}
+
+	Time t = _cacheTime;
+	elapsed += t.min * 60 + t.sec;
+	t.min = elapsed / 60;
+	t.sec = elapsed % 60;
+	return t;
+}
+
+// interval in ms, 0 turns the cache off
+void DS3231::setCacheInterval(unsigned long interval)
+{
+	_cacheInterval = interval;
+	_cacheValid = false;
+}
+
+// Counts seconds by tick() calls from the 1 Hz SQW interrupt instead of millis()
+void DS3231::useSQWTicks(bool enable)
+{
+	_cacheUseTicks = enable;
+	_cacheValid = false;
+}
+
+void DS3231::tick()
+{
+	_cacheTicks++;
+}
+
 void DS3231::setTime(uint8_t hour, uint8_t min, uint8_t sec)
 {
 	if (((hour>=0) && (hour<24)) && ((min>=0) && (min<60)) && ((sec>=0) && (sec<60)))
 	{
-		_writeRegister(REG_HOUR, _encode(hour));
-		_writeRegister(REG_MIN, _encode(min));
-		_writeRegister(REG_SEC, _encode(sec));
+		_burstArray[0] = _encode(sec);
+		_burstArray[1] = _encode(min);
+		_burstArray[2] = _encode(hour);
+		_writeRegisters(REG_SEC, _burstArray, 3);
+		_cacheValid = false;
+	}
+}
+
+// Writes time and day of week in one transaction, the date is left alone
+void DS3231::setTime(uint8_t hour, uint8_t min, uint8_t sec, uint8_t dow)
+{
+	if ((hour<24) && (min<60) && (sec<60) && (dow>0) && (dow<8))
+	{
+		_burstArray[0] = _encode(sec);
+		_burstArray[1] = _encode(min);
+		_burstArray[2] = _encode(hour);
+		_burstArray[3] = dow;
+		_writeRegisters(REG_SEC, _burstArray, 4);
+		_cacheValid = false;
 	}
 }
 
@@ -95,9 +213,30 @@ void DS3231::setDate(uint8_t date, uint8_t mon, uint16_t year)
 	if (((date>0) && (date<=31)) && ((mon>0) && (mon<=12)) && ((year>=2000) && (year<3000)))
 	{
 		year -= 2000;
-		_writeRegister(REG_YEAR, _encode(year));
-		_writeRegister(REG_MON, _encode(mon));
-		_writeRegister(REG_DATE, _encode(date));
+		_burstArray[0] = _encode(date);
+		_burstArray[1] = _encode(mon);
+		_burstArray[2] = _encode(year);
+		_writeRegisters(REG_DATE, _burstArray, 3);
+		_cacheValid = false;
+	}
+}
+
+// Writes time, day of week and date in one transaction, so the clock
+// can't roll over between the registers
+void DS3231::setDateTime(Time t)
+{
+	if ((t.hour<24) && (t.min<60) && (t.sec<60) && (t.dow>0) && (t.dow<8) &&
+		(t.date>0) && (t.date<=31) && (t.mon>0) && (t.mon<=12) && (t.year>=2000) && (t.year<3000))
+	{
+		_burstArray[0] = _encode(t.sec);
+		_burstArray[1] = _encode(t.min);
+		_burstArray[2] = _encode(t.hour);
+		_burstArray[3] = t.dow;
+		_burstArray[4] = _encode(t.date);
+		_burstArray[5] = _encode(t.mon);
+		_burstArray[6] = _encode(t.year - 2000);
+		_writeRegisters(REG_SEC, _burstArray, 7);
+		_cacheValid = false;
 	}
 }
 
@@ -116,19 +255,23 @@ void DS3231::setDOW()
 	while (dow>7)
 		dow -= 7;
 	_writeRegister(REG_DOW, dow);
+	_cacheValid = false;
 }
 
 void DS3231::setDOW(uint8_t dow)
 {
 	if ((dow>0) && (dow<8))
+	{
 		_writeRegister(REG_DOW, dow);
+		_cacheValid = false;
+	}
 }
 
 char *DS3231::getTimeStr(uint8_t format)
 {
 	static char output[] = "xxxxxxxx";
 	Time t;
-	t=getTime();
+	t=getCachedTime();
 	if (t.hour<10)
 		output[0]=48;
 	else
@@ -160,7 +303,7 @@ char *DS3231::getDateStr(uint8_t slformat, uint8_t eformat, char divider)
 	static char output[] = "xxxxxxxxxx";
 	int yr, offset;
 	Time t;
-	t=getTime();
+	t=getCachedTime();
 	switch (eformat)
 	{
 		case FORMAT_LITTLEENDIAN:
@@ -276,7 +419,7 @@ char *DS3231::getDOWStr(uint8_t format)
 	char *daysLong[]  = {"Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday"};
 	char *daysShort[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
 	Time t;
-	t=getTime();
+	t=getCachedTime();
 	if (format == FORMAT_SHORT)
 		output = daysShort[t.dow-1];
 	else
@@ -290,7 +433,7 @@ char *DS3231::getMonthStr(uint8_t format)
 	char *monthLong[]  = {"January", "February", "March", "April", "May", "June", "July", "August", "September", "October", "November", "December"};
 	char *monthShort[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 	Time t;
-	t=getTime();
+	t=getCachedTime();
 	if (format == FORMAT_SHORT)
 		output = monthShort[t.mon-1];
 	else
@@ -339,84 +482,307 @@ void DS3231::setSQWRate(int rate)
 
 float DS3231::getTemp()
 {
-	uint8_t _msb = _readRegister(REG_TEMPM);
-	uint8_t _lsb = _readRegister(REG_TEMPL);
-	return (float)_msb + ((_lsb >> 6) * 0.25f);
+	return getTempFixed() * 0.25f;
+}
+
+// Temperature in 0.25 C steps, both registers in one read. Every reading
+// also goes into the getTempAverage() filter. A failed read is left out of
+// the filter and returns the current average instead.
+int16_t DS3231::getTempFixed()
+{
+	uint8_t _temp[2];
+	uint16_t errors = _busErrors;
+	_readRegisters(REG_TEMPM, _temp, 2);
+	if (_busErrors != errors)
+		return getTempAverage();
+	int16_t value = ((int16_t)(int8_t)_temp[0] << 2) | (_temp[1] >> 6);
+
+	_tempSamples[_tempSampleNum] = value;
+	_tempSampleNum = (_tempSampleNum + 1) % DS3231_TEMP_FILTER_SIZE;
+	if (_tempSampleCount < DS3231_TEMP_FILTER_SIZE)
+		_tempSampleCount++;
+	return value;
+}
+
+// Moving average of the last DS3231_TEMP_FILTER_SIZE getTempFixed()
+// readings in 0.25 C steps, no bus access
+int16_t DS3231::getTempAverage()
+{
+	int32_t sum = 0;
+
+	if (_tempSampleCount == 0)
+		return 0;
+	for (uint8_t i = 0; i < _tempSampleCount; i++)
+		sum += _tempSamples[i];
+	return sum / _tempSampleCount;
+}
+
+// Starts a conversion (CONV) unless one is running (BSY), returns at once
+bool DS3231::startTempConversion()
+{
+	uint8_t _reg[2];
+	_readRegisters(REG_CON, _reg, 2);
+	if ((_reg[0] & (1 << 5)) || (_reg[1] & (1 << 2)))
+		return false;
+	_writeRegister(REG_CON, _reg[0] | (1 << 5));
+	return true;
+}
+
+// True when neither a forced (CONV) nor an automatic (BSY) conversion runs
+bool DS3231::isTempReady()
+{
+	uint8_t _reg[2];
+	_readRegisters(REG_CON, _reg, 2);
+	return !(_reg[0] & (1 << 5)) && !(_reg[1] & (1 << 2));
+}
+
+// day is the date for ALARM_MATCH_DATE and 1..7 for ALARM_MATCH_DOW
+void DS3231::setAlarm1(uint8_t day, uint8_t hour, uint8_t min, uint8_t sec, uint8_t mode)
+{
+	_burstArray[0] = _encode(sec) | (mode < ALARM_MATCH_SEC ? 0x80 : 0);
+	_writeAlarm(REG_ALARM1, day, hour, min, mode, 1);
+}
+
+void DS3231::setAlarm2(uint8_t day, uint8_t hour, uint8_t min, uint8_t mode)
+{
+	_writeAlarm(REG_ALARM2, day, hour, min, mode, 0);
+}
+
+// Lets the alarm pull the INT/SQW pin low, which also switches the pin
+// from the square wave to interrupt output (INTCN). That stops the 1 Hz
+// time base of useSQWTicks(): getCachedTime() then falls back to millis().
+void DS3231::enableAlarm(uint8_t alarm, bool enable)
+{
+	uint8_t _reg = _readRegister(REG_CON);
+	if (enable)
+		_reg |= alarm | (1 << 2);
+	else
+		_reg &= ~alarm;
+	_writeRegister(REG_CON, _reg);
+}
+
+// Returns and clears the A1F/A2F flag, it is set on a match even if the
+// alarm interrupt is disabled. The flags can only be cleared, so the other
+// one is written back as 1: a match between the read and the write stays.
+bool DS3231::checkAlarm(uint8_t alarm)
+{
+	uint8_t _reg = _readRegister(REG_STATUS);
+	if (!(_reg & alarm))
+		return false;
+	_writeRegister(REG_STATUS, (_reg | (ALARM_1 | ALARM_2)) & ~alarm);
+	return true;
+}
+
+// Bus transfers given up since begin(): failed TWI transfers (see the
+// microWire counters for the cause) and missing ACKs on the software bus
+uint16_t DS3231::getBusErrors()
+{
+	return _busErrors;
 }
 
 /* Private */
 
+// Software I2C. The lines are open drain: low is driven, high is released
+// to the pull-ups, so an answering device can't be shorted. Every half bit
+// takes DS3231_SOFT_I2C_DELAY us plus the pin access. On AVR that is a call
+// that saves SREG, disables interrupts and does two read-modify-writes
+// through port pointers, about 40 cycles (2.5 us at 16 MHz) per edge; a
+// data bit needs three of them.
+
 void	DS3231::_sendStart(byte addr)
 {
-	pinMode(_sda_pin, OUTPUT);
-	digitalWrite(_sda_pin, HIGH);
-	digitalWrite(_scl_pin, HIGH);
-	digitalWrite(_sda_pin, LOW);
-	digitalWrite(_scl_pin, LOW);
-	shiftOut(_sda_pin, _scl_pin, MSBFIRST, addr);
+	_sdaRelease();
+	DS3231_SOFT_I2C_WAIT();
+	_sclRelease();
+	DS3231_SOFT_I2C_WAIT();
+	_sdaLow();
+	DS3231_SOFT_I2C_WAIT();
+	_sclLow();
+	_writeByte(addr);
 }
 
 void	DS3231::_sendStop()
 {
-	pinMode(_sda_pin, OUTPUT);
-	digitalWrite(_sda_pin, LOW);
-	digitalWrite(_scl_pin, HIGH);
-	digitalWrite(_sda_pin, HIGH);
-	pinMode(_sda_pin, INPUT);
+	_sdaLow();
+	DS3231_SOFT_I2C_WAIT();
+	_sclRelease();
+	DS3231_SOFT_I2C_WAIT();
+	_sdaRelease();
+	DS3231_SOFT_I2C_WAIT();
 }
 
 void	DS3231::_sendNack()
 {
-	pinMode(_sda_pin, OUTPUT);
-	digitalWrite(_scl_pin, LOW);
-	digitalWrite(_sda_pin, HIGH);
-	digitalWrite(_scl_pin, HIGH);
-	digitalWrite(_scl_pin, LOW);
-	pinMode(_sda_pin, INPUT);
+	_sdaRelease();
+	DS3231_SOFT_I2C_WAIT();
+	_sclRelease();
+	DS3231_SOFT_I2C_WAIT();
+	_sclLow();
 }
 
 void	DS3231::_sendAck()
 {
-	pinMode(_sda_pin, OUTPUT);
-	digitalWrite(_scl_pin, LOW);
-	digitalWrite(_sda_pin, LOW);
-	digitalWrite(_scl_pin, HIGH);
-	digitalWrite(_scl_pin, LOW);
-	pinMode(_sda_pin, INPUT);
+	_sdaLow();
+	DS3231_SOFT_I2C_WAIT();
+	_sclRelease();
+	DS3231_SOFT_I2C_WAIT();
+	_sclLow();
+	_sdaRelease();
 }
 
-void	DS3231::_waitForAck()
+// Gives up after DS3231_SOFT_I2C_ACK_TIMEOUT half bits without an ACK,
+// which counts as a bus error
+bool	DS3231::_waitForAck()
 {
-	pinMode(_sda_pin, INPUT);
-	digitalWrite(_scl_pin, HIGH);
-	while (digitalRead(_sda_pin)==HIGH) {}
-	digitalWrite(_scl_pin, LOW);
+	bool ack = false;
+
+	_sdaRelease();
+	DS3231_SOFT_I2C_WAIT();
+	_sclRelease();
+	for (uint8_t i = 0; i < DS3231_SOFT_I2C_ACK_TIMEOUT; i++)
+	{
+		DS3231_SOFT_I2C_WAIT();
+		if (!_sdaRead())
+		{
+			ack = true;
+			break;
+		}
+	}
+	_sclLow();
+	if (!ack)
+		_busErrors++;
+	return ack;
 }
 
 uint8_t DS3231::_readByte()
 {
-	pinMode(_sda_pin, INPUT);
-
 	uint8_t value = 0;
-	uint8_t currentBit = 0;
 
-	for (int i = 0; i < 8; ++i)
+	_sdaRelease();
+	for (uint8_t i = 0; i < 8; i++)
 	{
-		digitalWrite(_scl_pin, HIGH);
-		currentBit = digitalRead(_sda_pin);
-		value |= (currentBit << 7-i);
-		delayMicroseconds(1);
-		digitalWrite(_scl_pin, LOW);
+		DS3231_SOFT_I2C_WAIT();
+		_sclRelease();
+		DS3231_SOFT_I2C_WAIT();
+		value = (value << 1) | _sdaRead();
+		_sclLow();
 	}
 	return value;
 }
 
 void DS3231::_writeByte(uint8_t value)
 {
-	pinMode(_sda_pin, OUTPUT);
-	shiftOut(_sda_pin, _scl_pin, MSBFIRST, value);
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (value & 0x80)
+			_sdaRelease();
+		else
+			_sdaLow();
+		value <<= 1;
+		DS3231_SOFT_I2C_WAIT();
+		_sclRelease();
+		DS3231_SOFT_I2C_WAIT();
+		_sclLow();
+	}
+}
+
+// START, address and register pointer. A NACK ends the transfer with a
+// STOP, _waitForAck() has already counted it in _busErrors
+bool	DS3231::_softSelect(uint8_t reg)
+{
+	_sendStart(DS3231_ADDR_W);
+	if (_waitForAck())
+	{
+		_writeByte(reg);
+		if (_waitForAck())
+			return true;
+	}
+	_sendStop();
+	return false;
+}
+
+// A failed read leaves the buffer untouched
+void	DS3231::_softReadRegisters(uint8_t reg, uint8_t *buffer, uint8_t count)
+{
+	if (!_softSelect(reg))
+		return;
+	_sendStart(DS3231_ADDR_R);
+	if (_waitForAck())
+	{
+		for (uint8_t i=0; i<count; i++)
+		{
+			buffer[i] = _readByte();
+			if (i<count-1)
+				_sendAck();
+			else
+				_sendNack();
+		}
+	}
+	_sendStop();
+}
+
+void	DS3231::_softWriteRegisters(uint8_t reg, const uint8_t *buffer, uint8_t count)
+{
+	if (!_softSelect(reg))
+		return;
+	for (uint8_t i=0; i<count; i++)
+	{
+		_writeByte(buffer[i]);
+		if (!_waitForAck())
+			break;
+	}
+	_sendStop();
 }
 
+#if defined(__AVR__)
+// Low clears the pull-up first, release enables it again. The ports are
+// shared with pins that interrupt handlers drive, so every read-modify-write
+// runs with interrupts off, the same way digitalWrite() does it
+void	DS3231::_sdaLow()
+{
+	uint8_t oldSREG = SREG;
+	cli();
+	*_sda_port &= ~_sda_mask;
+	*_sda_ddr |= _sda_mask;
+	SREG = oldSREG;
+}
+
+void	DS3231::_sdaRelease()
+{
+	uint8_t oldSREG = SREG;
+	cli();
+	*_sda_ddr &= ~_sda_mask;
+	*_sda_port |= _sda_mask;
+	SREG = oldSREG;
+}
+
+void	DS3231::_sclLow()
+{
+	uint8_t oldSREG = SREG;
+	cli();
+	*_scl_port &= ~_scl_mask;
+	*_scl_ddr |= _scl_mask;
+	SREG = oldSREG;
+}
+
+void	DS3231::_sclRelease()
+{
+	uint8_t oldSREG = SREG;
+	cli();
+	*_scl_ddr &= ~_scl_mask;
+	*_scl_port |= _scl_mask;
+	SREG = oldSREG;
+}
+
+bool	DS3231::_sdaRead()		{ return (*_sda_in & _sda_mask) != 0; }
+#else
+void	DS3231::_sdaLow()		{ digitalWrite(_sda_pin, LOW); pinMode(_sda_pin, OUTPUT); }
+void	DS3231::_sdaRelease()	{ pinMode(_sda_pin, INPUT_PULLUP); }
+void	DS3231::_sclLow()		{ digitalWrite(_scl_pin, LOW); pinMode(_scl_pin, OUTPUT); }
+void	DS3231::_sclRelease()	{ pinMode(_scl_pin, INPUT_PULLUP); }
+bool	DS3231::_sdaRead()		{ return digitalRead(_sda_pin); }
+#endif
+
 uint8_t	DS3231::_decode(uint8_t value)
 {
 	uint8_t decoded = value & 127;
@@ -439,6 +805,19 @@ uint8_t	DS3231::_decodeY(uint8_t value)
 	return decoded;
 }
 
+// Minutes, hours and day/date registers after the first offset bytes of
+// _burstArray, all in one write. Bit 7 masks a field out.
+void DS3231::_writeAlarm(uint8_t reg, uint8_t day, uint8_t hour, uint8_t min, uint8_t mode, uint8_t offset)
+{
+	_burstArray[offset] = _encode(min) | (mode < ALARM_MATCH_MIN ? 0x80 : 0);
+	_burstArray[offset + 1] = _encode(hour) | (mode < ALARM_MATCH_HOUR ? 0x80 : 0);
+	if (mode == ALARM_MATCH_DOW)
+		_burstArray[offset + 2] = day | 0x40;
+	else
+		_burstArray[offset + 2] = _encode(day) | (mode < ALARM_MATCH_DATE ? 0x80 : 0);
+	_writeRegisters(reg, _burstArray, offset + 3);
+}
+
 uint8_t DS3231::_encode(uint8_t value)
 {
 	uint8_t encoded = ((value / 10) << 4) + (value % 10);
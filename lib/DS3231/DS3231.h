@@ -57,9 +57,28 @@
 #define SQW_RATE_4K		2
 #define SQW_RATE_8K		3
 
+// samples averaged by getTempAverage()
+#ifndef DS3231_TEMP_FILTER_SIZE
+	#define DS3231_TEMP_FILTER_SIZE	4
+#endif
+#if (DS3231_TEMP_FILTER_SIZE < 1) || (DS3231_TEMP_FILTER_SIZE > 255)
+	#error "DS3231_TEMP_FILTER_SIZE must be 1..255"
+#endif
+
 #define OUTPUT_SQW		0
 #define OUTPUT_INT		1
 
+#define ALARM_1			1
+#define ALARM_2			2
+
+// Alarm match modes, each one also matches the fields of the previous one
+#define ALARM_EVERY			0	// every second (Alarm 1) or minute (Alarm 2)
+#define ALARM_MATCH_SEC		1	// Alarm 1 only
+#define ALARM_MATCH_MIN		2
+#define ALARM_MATCH_HOUR	3
+#define ALARM_MATCH_DATE	4
+#define ALARM_MATCH_DOW		5
+
 class Time
 {
 public:
@@ -80,8 +99,14 @@ class DS3231
 		DS3231(uint8_t data_pin, uint8_t sclk_pin);
 		void	begin();
 		Time	getTime();
+		Time	getCachedTime();
+		void	setCacheInterval(unsigned long interval);
+		void	useSQWTicks(bool enable);
+		void	tick();
 		void	setTime(uint8_t hour, uint8_t min, uint8_t sec);
+		void	setTime(uint8_t hour, uint8_t min, uint8_t sec, uint8_t dow);
 		void	setDate(uint8_t date, uint8_t mon, uint16_t year);
+		void	setDateTime(Time t);
 		void	setDOW();
 		void	setDOW(uint8_t dow);
 
@@ -95,27 +120,67 @@ class DS3231
 		void	setOutput(byte enable);
 		void	setSQWRate(int rate);
 		float	getTemp();
+		int16_t	getTempFixed();
+		int16_t	getTempAverage();
+		bool	startTempConversion();
+		bool	isTempReady();
+
+		void	setAlarm1(uint8_t day, uint8_t hour, uint8_t min, uint8_t sec, uint8_t mode);
+		void	setAlarm2(uint8_t day, uint8_t hour, uint8_t min, uint8_t mode);
+		void	enableAlarm(uint8_t alarm, bool enable);
+		bool	checkAlarm(uint8_t alarm);
+
+		uint16_t	getBusErrors();
 
 	private:
 		uint8_t _scl_pin;
 		uint8_t _sda_pin;
 		uint8_t _burstArray[7];
+		Time	_cacheTime;
+		unsigned long	_cacheMillis;
+		unsigned long	_cacheInterval;
+		volatile uint16_t	_cacheTicks;
+		bool	_cacheValid;
+		bool	_cacheUseTicks;
+		int16_t	_tempSamples[DS3231_TEMP_FILTER_SIZE];
+		uint8_t	_tempSampleNum;
+		uint8_t	_tempSampleCount;
 		boolean	_use_hw;
+		uint16_t	_busErrors;
+#if defined(__AVR__)
+		volatile uint8_t	*_sda_ddr;
+		volatile uint8_t	*_sda_port;
+		volatile uint8_t	*_sda_in;
+		uint8_t	_sda_mask;
+		volatile uint8_t	*_scl_ddr;
+		volatile uint8_t	*_scl_port;
+		uint8_t	_scl_mask;
+#endif
 
 		void	_sendStart(byte addr);
 		void	_sendStop();
 		void	_sendAck();
 		void	_sendNack();
-		void	_waitForAck();
+		bool	_waitForAck();
+		void	_sdaLow();
+		void	_sdaRelease();
+		void	_sclLow();
+		void	_sclRelease();
+		bool	_sdaRead();
 		uint8_t	_readByte();
 		void	_writeByte(uint8_t value);
-		void	_burstRead();
+		bool	_softSelect(uint8_t reg);
+		void	_softReadRegisters(uint8_t reg, uint8_t *buffer, uint8_t count);
+		void	_softWriteRegisters(uint8_t reg, const uint8_t *buffer, uint8_t count);
+		void	_readRegisters(uint8_t reg, uint8_t *buffer, uint8_t count);
+		void	_writeRegisters(uint8_t reg, const uint8_t *buffer, uint8_t count);
 		uint8_t	_readRegister(uint8_t reg);
 		void 	_writeRegister(uint8_t reg, uint8_t value);
 		uint8_t	_decode(uint8_t value);
 		uint8_t	_decodeH(uint8_t value);
 		uint8_t	_decodeY(uint8_t value);
 		uint8_t	_encode(uint8_t vaule);
+		void	_writeAlarm(uint8_t reg, uint8_t day, uint8_t hour, uint8_t min, uint8_t mode, uint8_t offset);
 #if defined(__arm__)
 		Twi		*twi;
 #endif
@@ -45,53 +45,36 @@ void DS3231::begin()
 	}
 	else
 	{
-		pinMode(_scl_pin, OUTPUT);
+		_sdaRelease();
+		_sclRelease();
 	}
 }
 
-void DS3231::_burstRead()
+void DS3231::_readRegisters(uint8_t reg, uint8_t *buffer, uint8_t count)
 {
 	if (_use_hw)
 	{
 		// Set slave address and number of internal address bytes.
 		twi->TWI_MMR = (1 << 8) | TWI_MMR_MREAD | (DS3231_ADDR << 16);
 		// Set internal address bytes
-		twi->TWI_IADR = 0;
-		// Send START condition
-		twi->TWI_CR = TWI_CR_START;
+		twi->TWI_IADR = reg;
+		// Send START condition, with STOP right away for a single byte
+		if (count == 1)
+			twi->TWI_CR = TWI_CR_START | TWI_CR_STOP;
+		else
+			twi->TWI_CR = TWI_CR_START;
 
-		for (int i=0; i<6; i++)
+		for (uint8_t i=0; i<count; i++)
 		{
-			while ((twi->TWI_SR & TWI_SR_RXRDY) != TWI_SR_RXRDY)
-			{
-			};
-			_burstArray[i] = twi->TWI_RHR;
+			if ((i == count-1) && (count > 1))
+				twi->TWI_CR = TWI_CR_STOP;
+			while ((twi->TWI_SR & TWI_SR_RXRDY) != TWI_SR_RXRDY) {};
+			buffer[i] = twi->TWI_RHR;
 		}
-
-		twi->TWI_CR = TWI_CR_STOP;
-		while ((twi->TWI_SR & TWI_SR_RXRDY) != TWI_SR_RXRDY) {};
-		_burstArray[6] = twi->TWI_RHR;
 		while ((twi->TWI_SR & TWI_SR_TXCOMP) != TWI_SR_TXCOMP) {};
 	}
 	else
-	{
-		_sendStart(DS3231_ADDR_W);
-		_waitForAck();
-		_writeByte(0);
-		_waitForAck();
-		_sendStart(DS3231_ADDR_R);
-		_waitForAck();
-
-		for (int i=0; i<7; i++)
-		{
-			_burstArray[i] = _readByte();
-			if (i<6)
-				_sendAck();
-			else
-				_sendNack();
-		}
-		_sendStop();
-	}
+		_softReadRegisters(reg, buffer, count);
 }
 
 uint8_t DS3231::_readRegister(uint8_t reg)
@@ -111,17 +94,7 @@ uint8_t DS3231::_readRegister(uint8_t reg)
 		while ((twi->TWI_SR & TWI_SR_TXCOMP) != TWI_SR_TXCOMP) {};
 	}
 	else
-	{
-		_sendStart(DS3231_ADDR_W);
-		_waitForAck();
-		_writeByte(reg);
-		_waitForAck();
-		_sendStart(DS3231_ADDR_R);
-		_waitForAck();
-		readValue = _readByte();
-		_sendNack();
-		_sendStop();
-	}
+		_softReadRegisters(reg, &readValue, 1);
 	return readValue;
 }
 
@@ -141,14 +114,27 @@ void DS3231::_writeRegister(uint8_t reg, uint8_t value)
 		while ((twi->TWI_SR & TWI_SR_TXCOMP) != TWI_SR_TXCOMP) {};
 	}
 	else
+		_softWriteRegisters(reg, &value, 1);
+}
+
+void DS3231::_writeRegisters(uint8_t reg, const uint8_t *buffer, uint8_t count)
+{
+	if (_use_hw)
 	{
-		_sendStart(DS3231_ADDR_W);
-		_waitForAck();
-		_writeByte(reg);
-		_waitForAck();
-		_writeByte(value);
-		_waitForAck();
-		_sendStop();
+		// Set slave address and number of internal address bytes.
+		twi->TWI_MMR = (1 << 8) | (DS3231_ADDR << 16);
+		// Set internal address bytes
+		twi->TWI_IADR = reg;
+		// The first byte starts the transfer
+		for (uint8_t i=0; i<count; i++)
+		{
+			twi->TWI_THR = buffer[i];
+			while ((twi->TWI_SR & TWI_SR_TXRDY) != TWI_SR_TXRDY) {};
+		}
+		// Send STOP condition
+		twi->TWI_CR = TWI_CR_STOP;
+		while ((twi->TWI_SR & TWI_SR_TXCOMP) != TWI_SR_TXCOMP) {};
 	}
+	else
+		_softWriteRegisters(reg, buffer, count);
 }
-
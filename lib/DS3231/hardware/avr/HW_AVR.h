@@ -1,78 +1,44 @@
+#include <microWire.h>
+
 void DS3231::begin()
 {
 	if ((_sda_pin == SDA) and (_scl_pin == SCL))
 	{
 		_use_hw = true;
-		// activate internal pullups for twi.
-		digitalWrite(SDA, HIGH);
-		digitalWrite(SCL, HIGH);
-		//delay(1);  // Workaround for a linker bug
-
-		// initialize twi prescaler and bit rate
-		cbi(TWSR, TWPS0);
-		cbi(TWSR, TWPS1);
-		TWBR = ((F_CPU / TWI_FREQ) - 16) / 2;
-
-		// enable twi module, acks, and twi interrupt
-		TWCR = _BV(TWEN) | _BV(TWIE)/* | _BV(TWEA)*/;
+		// the TWI belongs to microWire: it owns the pull-ups, the bus clock
+		// (switched to TWI_FREQ before each DS3231 transfer), the timeouts
+		// and the bus recovery, and it waits for queued transfers of the
+		// other devices before ours
+		Wire.begin();
+		Wire.setClock(DS3231_ADDR, TWI_FREQ);
 	}
 	else
 	{
 		_use_hw = false;
-		pinMode(_scl_pin, OUTPUT);
+		// resolve the pins to port registers once, the bus code then uses
+		// single instructions instead of digitalWrite/pinMode
+		_sda_ddr = portModeRegister(digitalPinToPort(_sda_pin));
+		_sda_port = portOutputRegister(digitalPinToPort(_sda_pin));
+		_sda_in = portInputRegister(digitalPinToPort(_sda_pin));
+		_sda_mask = digitalPinToBitMask(_sda_pin);
+		_scl_ddr = portModeRegister(digitalPinToPort(_scl_pin));
+		_scl_port = portOutputRegister(digitalPinToPort(_scl_pin));
+		_scl_mask = digitalPinToBitMask(_scl_pin);
+		_sdaRelease();
+		_sclRelease();
 	}
 }
 
-void DS3231::_burstRead()
+// A failed read may leave the buffer partly filled
+void DS3231::_readRegisters(uint8_t reg, uint8_t *buffer, uint8_t count)
 {
 	if (_use_hw)
 	{
-		// Send start address
-		TWCR = _BV(TWEN) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);						// Send START
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWDR = DS3231_ADDR_W;
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWDR = 0;
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-
-		// Read data starting from start address
-		TWCR = _BV(TWEN) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);						// Send rep. START
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWDR = DS3231_ADDR_R;
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		for (int i=0; i<7; i++)
-		{
-			TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);								// Send ACK and clear TWINT to proceed
-			while ((TWCR & _BV(TWINT)) == 0) {};									// Wait for TWI to be ready
-			_burstArray[i] = TWDR;
-		}
-		TWCR = _BV(TWEN) | _BV(TWINT);												// Send NACK and clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-
-		TWCR = _BV(TWEN)| _BV(TWINT) | _BV(TWSTO);									// Send STOP
+		if (Wire.writeThenRead(DS3231_ADDR, &reg, 1, buffer, count) != TWI_OK)
+			_busErrors++;
 	}
 	else
-	{
-		_sendStart(DS3231_ADDR_W);
-		_waitForAck();
-		_writeByte(0);
-		_waitForAck();
-		_sendStart(DS3231_ADDR_R);
-		_waitForAck();
-
-		for (int i=0; i<7; i++)
-		{
-			_burstArray[i] = _readByte();
-			if (i<6)
-				_sendAck();
-			else
-				_sendNack();
-		}
-		_sendStop();
-	}
+		_softReadRegisters(reg, buffer, count);
 }
 
 uint8_t DS3231::_readRegister(uint8_t reg)
@@ -81,42 +47,11 @@ uint8_t DS3231::_readRegister(uint8_t reg)
 
 	if (_use_hw)
 	{
-		// Send start address
-		TWCR = _BV(TWEN) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);						// Send START
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWDR = DS3231_ADDR_W;
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWDR = reg;
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-
-		// Read data starting from start address
-		TWCR = _BV(TWEN) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);						// Send rep. START
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWDR = DS3231_ADDR_R;
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Send ACK and clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		readValue = TWDR;
-		TWCR = _BV(TWEN) | _BV(TWINT);												// Send NACK and clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-
-		TWCR = _BV(TWEN)| _BV(TWINT) | _BV(TWSTO);									// Send STOP
+		if (Wire.writeThenRead(DS3231_ADDR, &reg, 1, &readValue, 1) != TWI_OK)
+			_busErrors++;
 	}
 	else
-	{
-		_sendStart(DS3231_ADDR_W);
-		_waitForAck();
-		_writeByte(reg);
-		_waitForAck();
-		_sendStart(DS3231_ADDR_R);
-		_waitForAck();
-		readValue = _readByte();
-		_sendNack();
-		_sendStop();
-	}
+		_softReadRegisters(reg, &readValue, 1);
 	return readValue;
 }
 
@@ -124,30 +59,26 @@ void DS3231::_writeRegister(uint8_t reg, uint8_t value)
 {
 	if (_use_hw)
 	{
-		// Send start address
-		TWCR = _BV(TWEN) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);						// Send START
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWDR = DS3231_ADDR_W;
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWDR = reg;
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-		TWDR = value;
-		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);									// Clear TWINT to proceed
-		while ((TWCR & _BV(TWINT)) == 0) {};										// Wait for TWI to be ready
-
-		TWCR = _BV(TWEN)| _BV(TWINT) | _BV(TWSTO);									// Send STOP
+		Wire.beginTransmission(DS3231_ADDR);
+		Wire.write(reg);
+		Wire.write(value);
+		if (Wire.endTransmission() != TWI_OK)
+			_busErrors++;
 	}
 	else
+		_softWriteRegisters(reg, &value, 1);
+}
+
+void DS3231::_writeRegisters(uint8_t reg, const uint8_t *buffer, uint8_t count)
+{
+	if (_use_hw)
 	{
-		_sendStart(DS3231_ADDR_W);
-		_waitForAck();
-		_writeByte(reg);
-		_waitForAck();
-		_writeByte(value);
-		_waitForAck();
-		_sendStop();
+		Wire.beginTransmission(DS3231_ADDR);
+		Wire.write(reg);
+		Wire.write(buffer, count);
+		if (Wire.endTransmission() != TWI_OK)
+			_busErrors++;
 	}
+	else
+		_softWriteRegisters(reg, buffer, count);
 }
-
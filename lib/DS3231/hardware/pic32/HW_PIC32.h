@@ -20,11 +20,12 @@ void DS3231::begin()
 	else
 	{
 		_use_hw = false;
-		pinMode(_scl_pin, OUTPUT);
+		_sdaRelease();
+		_sclRelease();
 	}
 }
 
-void DS3231::_burstRead()
+void DS3231::_readRegisters(uint8_t reg, uint8_t *buffer, uint8_t count)
 {
 	if (_use_hw)
 	{
@@ -40,7 +41,7 @@ void DS3231::_burstRead()
 		}
 		while (I2C1STAT & (1 << _I2CSTAT_TRSTAT)) {}		// Wait for transmit to finish
 		while (I2C1STAT & (1 << _I2CSTAT_ACKSTAT)) {}		// Wait for ACK
-		I2C1TRN = 0;										// Send the register address
+		I2C1TRN = reg;										// Send the register address
 		while (I2C1STAT & (1 << _I2CSTAT_TRSTAT)) {}		// Wait for transmit to finish
 		while (I2C1STAT & (1 << _I2CSTAT_ACKSTAT)) {}		// Wait for ACK
 		_waitForIdleBus();									// Wait for I2C bus to be Idle before starting
@@ -56,14 +57,14 @@ void DS3231::_burstRead()
 		while (I2C1STAT & (1 << _I2CSTAT_TRSTAT)) {}		// Wait for transmit to finish
 		while (I2C1STAT & (1 << _I2CSTAT_ACKSTAT)) {}		// Wait for ACK
 		byte dummy = I2C1RCV;								// Clear _I2CSTAT_RBF (Receive Buffer Full)
-		for (int i=0; i<7; i++)
+		for (uint8_t i=0; i<count; i++)
 		{
 			_waitForIdleBus();								// Wait for I2C bus to be Idle before continuing
 			I2C1CONSET = (1 << _I2CCON_RCEN);				// Set RCEN to start receive
 			while (I2C1CON & (1 << _I2CCON_RCEN)) {}		// Wait for Receive operation to finish
 			while (!(I2C1STAT & (1 << _I2CSTAT_RBF))) {}	// Wait for Receive Buffer Full
-			_burstArray[i] = I2C1RCV;						// Read data
-			if (i == 6)
+			buffer[i] = I2C1RCV;							// Read data
+			if (i == count-1)
 				I2C1CONSET = (1 << _I2CCON_ACKDT);			// Prepare to send NACK
 			else
 				I2C1CONCLR = (1 << _I2CCON_ACKDT);			// Prepare to send ACK
@@ -74,24 +75,7 @@ void DS3231::_burstRead()
 		while (I2C1CON & (1 << _I2CCON_PEN)) {}				// Wait for stop condition to finish
 	}
 	else
-	{
-		_sendStart(DS3231_ADDR_W);
-		_waitForAck();
-		_writeByte(0);
-		_waitForAck();
-		_sendStart(DS3231_ADDR_R);
-		_waitForAck();
-
-		for (int i=0; i<7; i++)
-		{
-			_burstArray[i] = _readByte();
-			if (i<6)
-				_sendAck();
-			else
-				_sendNack();
-		}
-		_sendStop();
-	}
+		_softReadRegisters(reg, buffer, count);
 }
 
 uint8_t DS3231::_readRegister(uint8_t reg)
@@ -140,17 +124,7 @@ uint8_t DS3231::_readRegister(uint8_t reg)
 		while (I2C1CON & (1 << _I2CCON_PEN)) {}				// Wait for stop condition to finish
 	}
 	else
-	{
-		_sendStart(DS3231_ADDR_W);
-		_waitForAck();
-		_writeByte(reg);
-		_waitForAck();
-		_sendStart(DS3231_ADDR_R);
-		_waitForAck();
-		readValue = _readByte();
-		_sendNack();
-		_sendStop();
-	}
+		_softReadRegisters(reg, &readValue, 1);
 	return readValue;
 }
 
@@ -180,13 +154,37 @@ void DS3231::_writeRegister(uint8_t reg, uint8_t value)
 		while (I2C1CON & (1 << _I2CCON_PEN)) {}				// Wait for stop condition to finish
 	}
 	else
+		_softWriteRegisters(reg, &value, 1);
+}
+
+void DS3231::_writeRegisters(uint8_t reg, const uint8_t *buffer, uint8_t count)
+{
+	if (_use_hw)
 	{
-		_sendStart(DS3231_ADDR_W);
-		_waitForAck();
-		_writeByte(reg);
-		_waitForAck();
-		_writeByte(value);
-		_waitForAck();
-		_sendStop();
+		_waitForIdleBus();									// Wait for I2C bus to be Idle before starting
+		I2C1CONSET = (1 << _I2CCON_SEN);					// Send start condition
+		if (I2C1STAT & (1 << _I2CSTAT_BCL)) { return; }		// Check if there is a bus collision
+		while (I2C1CON & (1 << _I2CCON_SEN)) {}				// Wait for start condition to finish
+		I2C1TRN = (DS3231_ADDR<<1);							// Send device Write address
+		while (I2C1STAT & (1 << _I2CSTAT_IWCOL))			// Check if there is a Write collision
+		{
+			I2C1STATCLR = (1 << _I2CSTAT_IWCOL);			// Clear Write collision flag
+			I2C1TRN = (DS3231_ADDR<<1);						// Retry send device Write address
+		}
+		while (I2C1STAT & (1 << _I2CSTAT_TRSTAT)) {}		// Wait for transmit to finish
+		while (I2C1STAT & (1 << _I2CSTAT_ACKSTAT)) {}		// Wait for ACK
+		I2C1TRN = reg;										// Send the register address
+		while (I2C1STAT & (1 << _I2CSTAT_TRSTAT)) {}		// Wait for transmit to finish
+		while (I2C1STAT & (1 << _I2CSTAT_ACKSTAT)) {}		// Wait for ACK
+		for (uint8_t i=0; i<count; i++)
+		{
+			I2C1TRN = buffer[i];							// Send the data byte
+			while (I2C1STAT & (1 << _I2CSTAT_TRSTAT)) {}	// Wait for transmit to finish
+			while (I2C1STAT & (1 << _I2CSTAT_ACKSTAT)) {}	// Wait for ACK
+		}
+		I2C1CONSET = (1 << _I2CCON_PEN);					// Send stop condition
+		while (I2C1CON & (1 << _I2CCON_PEN)) {}				// Wait for stop condition to finish
 	}
+	else
+		_softWriteRegisters(reg, buffer, count);
 }
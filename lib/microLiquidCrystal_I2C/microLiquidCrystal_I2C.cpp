@@ -6,23 +6,49 @@
 
 #include "Arduino.h"
 
-#define printIIC(args)	Wire.write(args)
 inline size_t LiquidCrystal_I2C::write(uint8_t value) {
-	send(value, Rs);
+	if (_buffered) {
+		bufferWrite(value);
+	} else {
+		send(value, Rs);
+	}
 	return 1;
 }
 
+size_t LiquidCrystal_I2C::write(const uint8_t *buffer, size_t size) {
+	if (_buffered) {
+		for (size_t i = 0; i < size; i++) {
+			bufferWrite(buffer[i]);
+		}
+		return size;
+	}
+	sendRun(0, buffer, size);
+	return size;
+}
+
 #else
 #include "WProgram.h"
 
-#define printIIC(args)	Wire.send(args)
 inline void LiquidCrystal_I2C::write(uint8_t value) {
-	send(value, Rs);
+	if (_buffered) {
+		bufferWrite(value);
+	} else {
+		send(value, Rs);
+	}
 }
 
 #endif
 #include "microWire.h"
 
+// Queue/send flags stored next to Rs and the backlight bit, none of them
+// reach the expander.
+// Settle codes: time the controller needs before it accepts the next byte.
+#define SLOW      B00010000  // clear/home, ~1.5ms
+#define SYNC      B00100000  // 4-bit sync step after power-on, >4.1ms
+#define POWERON   B00110000  // LCD supply rising after power-on, >40ms
+#define SETTLE    B00110000
+#define NIBBLE    B01000000  // high nibble only, used by the 4-bit sync
+#define RAW       B10000000  // plain expander write without an En pulse
 
 
 // When the display powers up, it is configured as follows:
@@ -50,15 +76,56 @@ LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t lcd_Addr,uint8_t lcd_cols,uint8_t l
   _cols = lcd_cols;
   _rows = lcd_rows;
   _backlightval = LCD_NOBACKLIGHT;
+  _buffered = false;
+  _cursorDirty = false;
+  _async = false;
+  _queueHead = 0;
+  _queueCount = 0;
+  _settleTime = 0;
+  _batchLength = 0;
+  _batchSettled = true;
+  _batchTransfer.status = TWI_OK;
+  _warmStart = false;
 }
 
 void LiquidCrystal_I2C::init(){
+	Wire.begin();
+	Wire.setClock(_Addr, LCD_I2C_CLOCK);
+	_warmStart = false;
+	init_priv();
+}
+
+// Skips the power-on waits when the display kept its state across an MCU
+// reset. Call after asyncOn() to let the init run in the background.
+// Reads and clears MCUSR: call it before anything else that needs the
+// reset cause, or save MCUSR first.
+void LiquidCrystal_I2C::initFast(){
+	Wire.begin();
+	Wire.setClock(_Addr, LCD_I2C_CLOCK);
+	_warmStart = isWarmStart();
 	init_priv();
 }
 
+bool LiquidCrystal_I2C::isWarmStart(){
+#if defined(MCUSR) && defined(PORF)
+	// PORF stays set until it is cleared, so clear MCUSR to let the next
+	// reset report only its own cause. Optiboot clears MCUSR before the
+	// sketch starts; then PORF always reads 0 and only the En probe
+	// below tells a power-on apart.
+	uint8_t resetFlags = MCUSR;
+	MCUSR = 0;
+	if (resetFlags & _BV(PORF)) {
+		return false;	// the display was powered up together with us
+	}
+#endif
+	// PCF8574 outputs come up all high after power-on, an initialised
+	// display is always left with En low
+	Wire.requestFrom(_Addr, (uint8_t)1);
+	return !(Wire.read() & En);
+}
+
 void LiquidCrystal_I2C::init_priv()
 {
-	Wire.begin();
 	_displayfunction = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
 	begin(_cols, _rows);  
 }
@@ -76,31 +143,28 @@ void LiquidCrystal_I2C::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
 
 	// SEE PAGE 45/46 FOR INITIALIZATION SPECIFICATION!
 	// according to datasheet, we need at least 40ms after power rises above 2.7V
-	// before sending commands. Arduino can turn on way befer 4.5V so we'll wait 50
-	delay(50); 
-  
+	// before sending commands. Arduino can turn on way befer 4.5V so we'll wait
+	// a second. A warm display is already powered, so there is nothing to wait for.
 	// Now we pull both RS and R/W low to begin commands
-	expanderWrite(_backlightval);	// reset expanderand turn backlight off (Bit 8 =1)
-	delay(1000);
+	send(0, RAW | (_warmStart ? 0 : POWERON));
 
   	//put the LCD into 4 bit mode
 	// this is according to the hitachi HD44780 datasheet
 	// figure 24, pg 46
+	// A warm display may sit between two nibbles, then the first step completes
+	// some command, at worst a 1.5ms return home.
 	
 	  // we start in 8bit mode, try to set 4 bit mode
-   write4bits(0x03 << 4);
-   delayMicroseconds(4500); // wait min 4.1ms
+   send(0x03 << 4, NIBBLE | (_warmStart ? SLOW : SYNC)); // wait min 4.1ms
    
    // second try
-   write4bits(0x03 << 4);
-   delayMicroseconds(4500); // wait min 4.1ms
+   send(0x03 << 4, NIBBLE | (_warmStart ? SLOW : SYNC)); // wait min 4.1ms
    
    // third go!
-   write4bits(0x03 << 4); 
-   delayMicroseconds(150);
+   send(0x03 << 4, NIBBLE | SLOW); // wait min 100us
    
    // finally, set to 4-bit interface
-   write4bits(0x02 << 4); 
+   send(0x02 << 4, NIBBLE); 
 
 
 	// set # lines, font size, etc.
@@ -125,23 +189,139 @@ void LiquidCrystal_I2C::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
 
 /********** high level commands, for the user! */
 void LiquidCrystal_I2C::clear(){
-	command(LCD_CLEARDISPLAY);// clear display, set cursor position to zero
-	delayMicroseconds(2000);  // this command takes a long time!
+	if (_buffered) {
+		// blank the shadow copy, only cells that held text get repainted
+		for (uint8_t row = 0; row < LCD_BUFFER_ROWS; row++) {
+			for (uint8_t col = 0; col < LCD_BUFFER_COLS; col++) {
+				if (_buffer[row][col] != ' ') {
+					_buffer[row][col] = ' ';
+					_dirty[row][col >> 3] |= 1 << (col & 7);
+				}
+			}
+		}
+		_col = 0;
+		_row = 0;
+		return;
+	}
+	send(LCD_CLEARDISPLAY, SLOW);// clear display, set cursor position to zero
 }
 
 void LiquidCrystal_I2C::home(){
-	command(LCD_RETURNHOME);  // set cursor position to zero
-	delayMicroseconds(2000);  // this command takes a long time!
+	if (_buffered) {
+		_col = 0;
+		_row = 0;
+		return;
+	}
+	send(LCD_RETURNHOME, SLOW);  // set cursor position to zero
 }
 
 void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row){
-	int row_offsets[] = { 0x00, 0x40, 0x14, 0x54 };
 	if ( row > _numlines ) {
 		row = _numlines-1;    // we count rows starting w/0
 	}
+	if (_buffered) {
+		if (col != _col || row != _row) _cursorDirty = true;
+		_col = col;
+		_row = row;
+		return;
+	}
+	setDDRAMAddr(col, row);
+}
+
+static const uint8_t row_offsets[] = { 0x00, 0x40, 0x14, 0x54 };
+
+void LiquidCrystal_I2C::setDDRAMAddr(uint8_t col, uint8_t row){
 	command(LCD_SETDDRAMADDR | (col + row_offsets[row]));
 }
 
+// Bytes are read with pgm_read_byte and sent as one run, like write(buffer, size)
+size_t LiquidCrystal_I2C::printPGM(const char *str){
+	size_t n = 0;
+	uint8_t c;
+	if (_buffered || _async) {
+		while ((c = pgm_read_byte(str + n)) != 0) {
+			if (_buffered) bufferWrite(c);
+			else enqueue(c, Rs);
+			n++;
+		}
+		return n;
+	}
+	beginRun();
+	while ((c = pgm_read_byte(str + n)) != 0) {
+		streamByte(c, Rs | _backlightval);
+		n++;
+	}
+	endRun();
+	return n;
+}
+
+/********** shadow framebuffer */
+
+void LiquidCrystal_I2C::bufferOn(){
+	if (_buffered) return;
+	// start from a blank screen so the shadow copy matches DDRAM
+	clear();
+	memset(_buffer, ' ', sizeof(_buffer));
+	memset(_dirty, 0, sizeof(_dirty));
+	_col = 0;
+	_row = 0;
+	_cursorDirty = true;
+	_buffered = true;
+}
+
+void LiquidCrystal_I2C::bufferOff(){
+	if (!_buffered) return;
+	flush();
+	_buffered = false;
+	setDDRAMAddr(_col, _row);
+}
+
+void LiquidCrystal_I2C::bufferWrite(uint8_t value){
+	if (_row < LCD_BUFFER_ROWS && _col < LCD_BUFFER_COLS && _col < _cols) {
+		if (_buffer[_row][_col] != value) {
+			_buffer[_row][_col] = value;
+			_dirty[_row][_col >> 3] |= 1 << (_col & 7);
+		}
+	}
+	_col++;
+}
+
+// Send every run of changed cells as one cursor move plus its characters.
+// In asynchronous mode only what fits into the queue is sent, the rest
+// stays dirty for the next flush, so a busy display never stalls the caller.
+// LCD_QUEUE_RESERVE entries stay free, so that blink() and the like sent
+// before the next flush don't have to wait either.
+// A visible cursor is then put back where setCursor() last left it.
+void LiquidCrystal_I2C::flush(){
+	if (!_buffered) return;
+	uint8_t room = 0xFF;
+	if (_async) {
+		room = _queueCount + LCD_QUEUE_RESERVE < LCD_QUEUE_SIZE ? LCD_QUEUE_SIZE - LCD_QUEUE_RESERVE - _queueCount : 0;
+	}
+	for (uint8_t row = 0; row < LCD_BUFFER_ROWS; row++) {
+		uint8_t col = 0;
+		while (col < LCD_BUFFER_COLS) {
+			if (!(_dirty[row][col >> 3] & (1 << (col & 7)))) {
+				col++;
+				continue;
+			}
+			if (room < 2) return;
+			uint8_t start = col;
+			while (col < LCD_BUFFER_COLS && col - start < room - 1 && (_dirty[row][col >> 3] & (1 << (col & 7)))) {
+				_dirty[row][col >> 3] &= ~(1 << (col & 7));
+				col++;
+			}
+			sendRun(LCD_SETDDRAMADDR | (start + row_offsets[row]), &_buffer[row][start], col - start);
+			if (_async) room -= col - start + 1;
+			_cursorDirty = true;
+		}
+	}
+	if (_cursorDirty && (_displaycontrol & (LCD_CURSORON | LCD_BLINKON)) && room > 0) {
+		setDDRAMAddr(_col, _row);
+		_cursorDirty = false;
+	}
+}
+
 // Turn the display on/off (quickly)
 void LiquidCrystal_I2C::noDisplay() {
 	_displaycontrol &= ~LCD_DISPLAYON;
@@ -158,6 +338,7 @@ void LiquidCrystal_I2C::noCursor() {
 	command(LCD_DISPLAYCONTROL | _displaycontrol);
 }
 void LiquidCrystal_I2C::cursor() {
+	_cursorDirty = true;
 	_displaycontrol |= LCD_CURSORON;
 	command(LCD_DISPLAYCONTROL | _displaycontrol);
 }
@@ -168,6 +349,7 @@ void LiquidCrystal_I2C::noBlink() {
 	command(LCD_DISPLAYCONTROL | _displaycontrol);
 }
 void LiquidCrystal_I2C::blink() {
+	_cursorDirty = true;
 	_displaycontrol |= LCD_BLINKON;
 	command(LCD_DISPLAYCONTROL | _displaycontrol);
 }
@@ -210,7 +392,7 @@ void LiquidCrystal_I2C::createChar(uint8_t location, uint8_t charmap[]) {
 	location &= 0x7; // we only have 8 locations 0-7
 	command(LCD_SETCGRAMADDR | (location << 3));
 	for (int i=0; i<8; i++) {
-		write(charmap[i]);
+		send(charmap[i], Rs);
 	}
 }
 
@@ -219,21 +401,115 @@ void LiquidCrystal_I2C::createChar(uint8_t location, const char *charmap) {
 	location &= 0x7; // we only have 8 locations 0-7
 	command(LCD_SETCGRAMADDR | (location << 3));
 	for (int i=0; i<8; i++) {
-	    	write(pgm_read_byte_near(charmap++));
+	    	send(pgm_read_byte_near(charmap++), Rs);
 	}
 }
 
 // Turn the (optional) backlight off/on
 void LiquidCrystal_I2C::noBacklight(void) {
 	_backlightval=LCD_NOBACKLIGHT;
-	expanderWrite(0);
+	send(0, RAW);
 }
 
 void LiquidCrystal_I2C::backlight(void) {
 	_backlightval=LCD_BACKLIGHT;
-	expanderWrite(0);
+	send(0, RAW);
+}
+
+
+
+/*********** asynchronous mode */
+
+void LiquidCrystal_I2C::asyncOn(){
+	_async = true;
+}
+
+void LiquidCrystal_I2C::asyncOff(){
+	while (!isIdle()) {
+		pump();
+	}
+	_async = false;
+}
+
+unsigned long LiquidCrystal_I2C::settleTime(uint8_t mode){
+	switch (mode & SETTLE) {
+		case SLOW: return 2000;
+		case SYNC: return 4500;
+		case POWERON: return 1050000;
+	}
+	return 0;
+}
+
+bool LiquidCrystal_I2C::isIdle(){
+	return !batchBusy() && _queueCount == 0 && micros() - _settleStart >= _settleTime;
+}
+
+uint8_t LiquidCrystal_I2C::pending(){
+	return _queueCount;
+}
+
+// The backlight bit is taken when the byte is queued, so backlight() and
+// noBacklight() only affect what is queued after them
+void LiquidCrystal_I2C::enqueue(uint8_t value, uint8_t mode){
+	while (_queueCount == LCD_QUEUE_SIZE) {
+		// queue is full, wait for the display to catch up: up to 1.05s
+		// behind a cold power-on settle, milliseconds otherwise
+		pump();
+	}
+	uint8_t i = _queueHead + _queueCount;
+	if (i >= LCD_QUEUE_SIZE) i -= LCD_QUEUE_SIZE;
+	_queueValue[i] = value;
+	_queueMode[i] = mode | _backlightval;
+	_queueCount++;
+}
+
+// Hand up to LCD_PUMP_BATCH queued bytes to the microWire queue as one
+// transaction, never waits: returns immediately while the previous batch
+// is on the bus or the last slow command is still executing.
+void LiquidCrystal_I2C::pump(){
+	if (batchBusy() || _queueCount == 0 || micros() - _settleStart < _settleTime) return;
+
+	_batchLength = 0;
+	_streamMode = 0xFF;
+	_settleTime = 0;
+	for (uint8_t sent = 0; _queueCount && sent < LCD_PUMP_BATCH; sent++) {
+		uint8_t value = _queueValue[_queueHead];
+		uint8_t mode = _queueMode[_queueHead];
+		if (++_queueHead == LCD_QUEUE_SIZE) _queueHead = 0;
+		_queueCount--;
+
+		emit(value, mode);
+		if (mode & SETTLE) {
+			_settleTime = settleTime(mode);
+			break;
+		}
+	}
+
+	_batchTransfer.address = _Addr;
+	_batchTransfer.writeData = _batch;
+	_batchTransfer.writeLength = _batchLength;
+	_batchTransfer.readData = 0;
+	_batchTransfer.readLength = 0;
+	_batchTransfer.callback = 0;
+	while (!Wire.submit(&_batchTransfer)) {
+		Wire.busy();  // the bus queue is full
+	}
+	_batchSettled = false;
 }
 
+// True while the last batch is on the bus. The settle time of its last
+// command starts when the batch is seen done, a little late at worst.
+bool LiquidCrystal_I2C::batchBusy(){
+	if (_batchTransfer.status == TWI_PENDING) {
+		Wire.busy();  // also gives up a stuck transfer
+		return true;
+	}
+	if (!_batchSettled) {
+		_batchSettled = true;
+		_settleStart = micros();
+	}
+	return false;
+}
 
 
 /*********** mid level commands, for sending data/cmds */
@@ -247,30 +523,102 @@ inline void LiquidCrystal_I2C::command(uint8_t value) {
 
 // write either command or data
 void LiquidCrystal_I2C::send(uint8_t value, uint8_t mode) {
-	uint8_t highnib=value&0xf0;
-	uint8_t lownib=(value<<4)&0xf0;
-       write4bits((highnib)|mode);
-	write4bits((lownib)|mode); 
+	if (_async) {
+		enqueue(value, mode);
+		return;
+	}
+	beginRun();
+	emit(value, mode | _backlightval);
+	endRun();
+
+	unsigned long settle = settleTime(mode);
+	if (settle > 16000) {
+		delay(settle / 1000);
+	} else if (settle) {
+		delayMicroseconds(settle);  // this command takes a long time!
+	}
 }
 
-void LiquidCrystal_I2C::write4bits(uint8_t value) {
-	expanderWrite(value);
-	pulseEnable(value);
+// Open a blocking transaction. The expander bytes collect in the batch
+// buffer and go out as whole buffers, a long run in several pieces.
+void LiquidCrystal_I2C::beginRun() {
+	while (batchBusy());  // the last pump() batch may still be on the bus
+	Wire.beginTransmission(_Addr);
+	_streamMode = 0xFF;
+	_batchLength = 0;
 }
 
-void LiquidCrystal_I2C::expanderWrite(uint8_t _data){                                        
-	Wire.beginTransmission(_Addr);
-	printIIC((int)(_data) | _backlightval);
-	Wire.endTransmission();   
+void LiquidCrystal_I2C::endRun() {
+	Wire.write(_batch, _batchLength);
+	Wire.endTransmission();
+}
+
+// one expander byte into the batch buffer, only a blocking run can fill it
+void LiquidCrystal_I2C::expanderOut(uint8_t value) {
+	if (_batchLength == sizeof(_batch)) {
+		Wire.write(_batch, _batchLength);
+		_batchLength = 0;
+	}
+	_batch[_batchLength++] = value;
+}
+
+// write one byte, a single nibble or a raw expander value into the open
+// transaction, mode carries the backlight bit to use
+void LiquidCrystal_I2C::emit(uint8_t value, uint8_t mode) {
+	uint8_t lines = mode & (Rs | LCD_BACKLIGHT);
+	if (mode & RAW) {
+		expanderOut(value | (mode & LCD_BACKLIGHT));
+		_streamMode = 0xFF;
+	} else if (mode & NIBBLE) {
+		uint8_t nib = (value & 0xf0) | lines;
+		expanderOut(nib);
+		expanderOut(nib | En);
+		expanderOut(nib);
+		_streamMode = lines;
+	} else {
+		streamByte(value, lines);
+	}
+}
+
+// write an optional command followed by a run of characters
+void LiquidCrystal_I2C::sendRun(uint8_t cmd, const uint8_t *data, size_t size) {
+	if (_async) {
+		if (cmd) enqueue(cmd, 0);
+		for (size_t i = 0; i < size; i++) {
+			enqueue(data[i], Rs);
+		}
+		return;
+	}
+	// the whole run goes out as a single I2C transaction
+	beginRun();
+	if (cmd) streamByte(cmd, _backlightval);
+	for (size_t i = 0; i < size; i++) {
+		streamByte(data[i], Rs | _backlightval);
+	}
+	endRun();
+}
+
+// Queue both nibbles of a byte into the open transaction as back-to-back
+// expander writes, mode holds Rs and the backlight bit. RS is set with En
+// low before the first pulse of a new mode, data lines only need to be
+// valid on the falling edge of En.
+// The next character's high nibble is latched two expander bytes after
+// this low nibble (En high, En low): 18 bits, 180us at the default 100kHz
+// and still 50us at the 360kHz LCD_I2C_CLOCK allows, which covers the 37us
+// execution time, so no extra delays are needed between characters.
+void LiquidCrystal_I2C::streamByte(uint8_t value, uint8_t mode) {
+	uint8_t highnib=(value&0xf0)|mode;
+	uint8_t lownib=((value<<4)&0xf0)|mode;
+	if (mode != _streamMode) {
+		expanderOut(highnib);
+		_streamMode = mode;
+	}
+	expanderOut(highnib | En);
+	expanderOut(highnib);
+	expanderOut(lownib | En);
+	expanderOut(lownib);
 }
 
-void LiquidCrystal_I2C::pulseEnable(uint8_t _data){
-	expanderWrite(_data | En);	// En high
-	delayMicroseconds(1);		// enable pulse must be >450ns
-	
-	expanderWrite(_data & ~En);	// En low
-	delayMicroseconds(50);		// commands need > 37us to settle
-} 
 
 
 // Alias functions
@@ -55,6 +55,44 @@
 #define Rw B00000010  // Read/Write bit
 #define Rs B00000001  // Register select bit
 
+// shadow framebuffer size, enough for a 20x4 module
+#ifndef LCD_BUFFER_COLS
+#define LCD_BUFFER_COLS 20
+#endif
+#ifndef LCD_BUFFER_ROWS
+#define LCD_BUFFER_ROWS 4
+#endif
+
+// Bus clock for the display, set as its microWire clock profile by
+// init()/initFast(). 100kHz is what the PCF8574 is rated for and keeps long
+// cables working. Characters are streamed without delays, two expander
+// bytes (18 bits) apart: 180us at 100kHz. Faster clocks are opt-in, up to
+// 360kHz, where the gap is the 50us the driver used to wait; the HD44780's
+// nominal 37us is not enough for controllers with a slow oscillator.
+#ifndef LCD_I2C_CLOCK
+#define LCD_I2C_CLOCK 100000
+#endif
+#if LCD_I2C_CLOCK > 360000
+#error "LCD_I2C_CLOCK is too fast for streamed characters"
+#endif
+
+// asynchronous mode: queued bytes and bytes sent per pump() call
+#ifndef LCD_QUEUE_SIZE
+#define LCD_QUEUE_SIZE 16
+#endif
+#ifndef LCD_PUMP_BATCH
+#define LCD_PUMP_BATCH 8
+#endif
+// queue entries flush() leaves free for commands sent between flushes
+#ifndef LCD_QUEUE_RESERVE
+#define LCD_QUEUE_RESERVE 4
+#endif
+// init() queues 10 entries and backlight() one more; they and the reserve
+// must fit, or the caller waits out the 1.05s power-on settle
+#if LCD_QUEUE_SIZE < 11 + LCD_QUEUE_RESERVE
+#error "LCD_QUEUE_SIZE is too small for init() and LCD_QUEUE_RESERVE"
+#endif
+
 class LiquidCrystal_I2C : public Print {
 public:
   LiquidCrystal_I2C(uint8_t lcd_Addr,uint8_t lcd_cols,uint8_t lcd_rows);
@@ -84,13 +122,37 @@ public:
   // Example: 	const char bell[8] PROGMEM = {B00100,B01110,B01110,B01110,B11111,B00000,B00100,B00000};
   
   void setCursor(uint8_t, uint8_t); 
+  size_t printPGM(const char *str);	// print a PROGMEM string without a RAM copy
 #if defined(ARDUINO) && ARDUINO >= 100
   virtual size_t write(uint8_t);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
 #else
   virtual void write(uint8_t);
 #endif
   void command(uint8_t);
   void init();
+  void initFast();
+
+  // Buffered mode: print/setCursor/clear/home only touch a shadow copy of
+  // DDRAM, flush() sends the cells that changed since the last flush.
+  // Assumes left-to-right entry mode without display shift. With cursor()
+  // or blink() on, the hardware cursor follows the buffered setCursor().
+  void bufferOn();
+  void bufferOff();
+  void flush();
+
+  // Asynchronous mode: commands and characters go into a bounded queue that
+  // pump() drains from loop() without blocking on execution times. Each
+  // batch goes out through the microWire transaction queue while loop()
+  // goes on. A full queue makes the caller wait for the display, at worst
+  // up to 1.05s while a cold init() waits for the display to power up.
+  // Buffered flush() never fills the last LCD_QUEUE_RESERVE entries.
+  void asyncOn();
+  void asyncOff();
+  void pump();
+  bool isIdle();
+  uint8_t pending();
 
 ////compatibility API function aliases
 void blink_on();						// alias for blink()
@@ -115,10 +177,19 @@ void draw_vertical_graph(uint8_t row, uint8_t column, uint8_t len,  uint8_t pixe
 
 private:
   void init_priv();
+  bool isWarmStart();
   void send(uint8_t, uint8_t);
-  void write4bits(uint8_t);
-  void expanderWrite(uint8_t);
-  void pulseEnable(uint8_t);
+  void emit(uint8_t, uint8_t);
+  void expanderOut(uint8_t);
+  void beginRun();
+  void endRun();
+  bool batchBusy();
+  unsigned long settleTime(uint8_t);
+  void setDDRAMAddr(uint8_t, uint8_t);
+  void bufferWrite(uint8_t);
+  void streamByte(uint8_t, uint8_t);
+  void sendRun(uint8_t, const uint8_t*, size_t);
+  void enqueue(uint8_t, uint8_t);
   uint8_t _Addr;
   uint8_t _displayfunction;
   uint8_t _displaycontrol;
@@ -127,6 +198,26 @@ private:
   uint8_t _cols;
   uint8_t _rows;
   uint8_t _backlightval;
+  uint8_t _streamMode;
+  bool _buffered;
+  bool _cursorDirty;
+  uint8_t _col;
+  uint8_t _row;
+  uint8_t _buffer[LCD_BUFFER_ROWS][LCD_BUFFER_COLS];
+  uint8_t _dirty[LCD_BUFFER_ROWS][(LCD_BUFFER_COLS + 7) / 8];
+  bool _async;
+  uint8_t _queueHead;
+  uint8_t _queueCount;
+  uint8_t _queueValue[LCD_QUEUE_SIZE];
+  uint8_t _queueMode[LCD_QUEUE_SIZE];
+  unsigned long _settleStart;
+  unsigned long _settleTime;
+  // a queued byte takes up to 5 expander writes
+  uint8_t _batch[LCD_PUMP_BATCH * 5];
+  uint8_t _batchLength;
+  bool _batchSettled;
+  TwiTransaction _batchTransfer;
+  bool _warmStart;
 };
 
 #endif
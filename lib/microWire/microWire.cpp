@@ -4,17 +4,79 @@ void TwoWire::begin()
 {	  												// Инициализация шины в роли master
 	pinMode(SDA, INPUT_PULLUP); 					// Подтяжка шины 
 	pinMode(SCL, INPUT_PULLUP);						// Подтяжка шины 
-	TWBR = 72;										// Стандартная скорость - 100kHz
+	_default_twbr = 72;								// Стандартная скорость - 100kHz
+	TWBR = 72;
 	TWSR = 0;										// Делитель - /1 , статус - 0;
+	if (!digitalRead(SDA)) TwoWire::recover();		// Ведомый держит SDA после сброса - освободить шину
 }
 
 void TwoWire::setClock(uint32_t clock) 
 { 													// Функция установки частоты шины 31-900 kHz (в герцах)
-	TWBR = (((long)F_CPU / clock) - 16) / 2; 		// Расчет baudrate - регистра
+	_default_twbr = twbrFor(clock);					// Для всех устройств без своей частоты
+	TWBR = _default_twbr;
+}
+
+void TwoWire::setClock(uint8_t address , uint32_t clock)
+{													// Частота шины для одного устройства
+	uint8_t i = 0;
+	while (i < _profiles && _profile_address[i] != address) i++;	// Поиск устройства в таблице
+	if (i == TWI_CLOCK_PROFILES) return;			// Таблица заполнена - устройство работает на общей частоте
+	if (i == _profiles) _profiles++;				// Новое устройство
+	_profile_address[i] = address;
+	_profile_twbr[i] = twbrFor(clock);
+}
+
+uint32_t TwoWire::calibrate(uint8_t address , uint32_t maxClock)
+{													// Поиск максимальной надежной частоты устройства
+	static const uint32_t clocks[] = {800000 , 400000 , 200000 , 100000 , 50000};	// Проверяемые частоты
+	TwiCounters counters = _counters;				// Ошибки при калибровке не считаются
+	bool timeoutFlag = _timeout_flag;
+	uint32_t found = 0;
+	for (uint8_t i = 0; i < sizeof(clocks) / sizeof(clocks[0]) && !found; i++) {
+		if (clocks[i] > maxClock) continue;			// Выше допустимой частоты
+		TwoWire::setClock(address , clocks[i]);
+		bool reliable = true;
+		for (uint8_t n = 0; n < TWI_CALIBRATION_PROBES && reliable; n++) {
+			TwoWire::beginTransmission(address);	// Адрес + "write" без данных - ничего не меняет в устройстве
+			if (TwoWire::endTransmission()) reliable = false;
+			TwoWire::requestFrom(address , 1);		// Адрес + "read" и один байт
+			if ((TWSR & 0xF8) != 0x40) {			// Нет ответа или таймаут
+				_requested_bytes = 0;
+				TwoWire::stop();
+				reliable = false;
+			} else {
+				TwoWire::read();
+				if (_failed) reliable = false;
+			}
+		}
+		if (reliable) found = clocks[i];
+	}
+	if (!found) TwoWire::setClock(address , 100000);	// Устройство не отвечает - стандартная частота
+	_counters = counters;
+	_timeout_flag = timeoutFlag;
+	return found;
+}
+
+uint8_t TwoWire::twbrFor(uint32_t clock)
+{													// Расчет baudrate - регистра
+	long twbr = (((long)F_CPU / clock) - 16) / 2;
+	if (twbr < 0) return 0;							// Быстрее F_CPU / 16 нельзя
+	if (twbr > 255) return 255;						// Медленнее нельзя без делителя
+	return twbr;
+}
+
+uint8_t TwoWire::clockFor(uint8_t address)
+{													// TWBR для устройства
+	for (uint8_t i = 0; i < _profiles; i++) {
+		if (_profile_address[i] == address) return _profile_twbr[i];
+	}
+	return _default_twbr;
 }
 
 void TwoWire::beginTransmission(uint8_t address) 
 { 													// Начать передачу (для записи данных)
+	_failed = false;								// Новая транзакция
+	_twbr = TwoWire::clockFor(address);				// Частота этого устройства
 	TwoWire::start();                        		// Старт
 	TwoWire::write(address << 1);            		// Отправка slave - устройству адреса с битом "write"
 }
@@ -28,27 +90,93 @@ uint8_t TwoWire::endTransmission(bool stop)
 {													// Завершить передачу (после записи данных)
   if (stop) TwoWire::stop();                    	// Если задано stop или аргумент пуст - отпустить шину
   else TwoWire::start();                      		// Иначе - restart (другой master на шине не сможет влезть между сообщениями)
-  if (_address_nack) {               				// Если нет ответа при передаче адреса
+  if (_failed) {               						// Если истекло время ожидания
+    _address_nack = false;            				// Обнуляем оба флага
+    _data_nack = false;               				// Обнуляем оба флага
+    return TWI_TIMEOUT;                   			// Возвращаем '5' , шина уже восстановлена
+  } if (_address_nack) {               				// Если нет ответа при передаче адреса
     _address_nack = false;            				// Обнуляем оба флага
     _data_nack = false;               				// Обнуляем оба флага
+    _counters.addressNack++;
     return 2;                   					// Возвращаем '2'
   } if (_data_nack) {               				// Если нет ответа при передаче данных
     _address_nack = false;             				// Обнуляем оба флага
     _data_nack = false;              				// Обнуляем оба флага
+    _counters.dataNack++;
     return 3;                   					// Возвращаем '2'
   } return 0;										// Если все ОК - возвращаем '0'
 }
 
 void TwoWire::write(uint8_t data)
 {													// Прямая отправка байта на шину
+	if (_failed) return;							// Транзакция прервана по таймауту
 	TWDR = data;									// Записать данные в data - регистр
 	TWCR = _BV(TWEN) | _BV(TWINT);				    // Запустить передачу
-	while (!(TWCR & _BV(TWINT)));					// Дождаться окончания
+	if (!TwoWire::wait()) return;					// Дождаться окончания
 	uint8_t _bus_status = TWSR & 0xF8;				// Чтение статуса шины
 	if(_bus_status == 0x20) _address_nack = true;	// SLA + W + NACK ? - нет ответа при передаче адреса
 	if(_bus_status == 0x30) _data_nack = true;		// BYTE + NACK ? - нет ответа при передаче данных
 }
 
+void TwoWire::write(const uint8_t *data , uint8_t length)
+{													// Отправка буфера на шину
+	if (_failed || _address_nack || _data_nack) return;	// Устройство не отвечает или транзакция прервана
+	for (uint8_t i = 0; i < length; i++) {
+		TWDR = data[i];								// Записать данные в data - регистр
+		TWCR = _BV(TWEN) | _BV(TWINT);				// Запустить передачу
+		if (!TwoWire::wait()) return;				// Дождаться окончания
+		if ((TWSR & 0xF8) != 0x28) {				// Все , кроме BYTE + ACK , - нет ответа при передаче данных
+			_data_nack = true;
+			return;
+		}
+	}
+}
+
+uint8_t TwoWire::readInto(uint8_t *data , uint8_t length)
+{													// Чтение запрошенных байт в буфер
+	if (length > _requested_bytes) length = _requested_bytes;	// Не больше , чем запрошено
+	uint8_t count = 0;
+	for (; count < length && _requested_bytes > 1; count++) {	// Все , кроме последнего запрошенного , - с "ACK"
+		if (!_failed) {
+			TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);	// Запустить чтение шины (с подтверждением "ACK")
+			TwoWire::wait();						// Дождаться окончания приема данных
+		}
+		if (_failed) {								// Транзакция прервана по таймауту
+			_requested_bytes = 0;
+			TwoWire::stop();						// Освободить шину для очереди
+			return count;
+		}
+		data[count] = TWDR;
+		_requested_bytes--;
+	}
+	if (count < length) {							// Последний запрошенный байт - "NACK" , stop или restart
+		uint8_t value = TwoWire::read();
+		if (_failed) return count;
+		data[count++] = value;
+	}
+	return count;
+}
+
+uint8_t TwoWire::writeThenRead(uint8_t address , const uint8_t *data , uint8_t length , uint8_t *dst , uint8_t count)
+{													// Запись , restart и чтение одной транзакцией (например , адрес регистра и его содержимое)
+	TwoWire::beginTransmission(address);
+	TwoWire::write(data , length);
+	if (!count || _failed || _address_nack || _data_nack) {	// Читать не нужно или запись не удалась
+		return TwoWire::endTransmission();			// stop и код ошибки
+	}
+	TwoWire::requestFrom(address , count);			// restart - шина не отпускалась
+	if ((TWSR & 0xF8) != 0x40) {					// SLA + R без ответа или таймаут
+		bool failed = _failed;
+		_requested_bytes = 0;
+		TwoWire::stop();
+		if (failed) return TWI_TIMEOUT;
+		_counters.addressNack++;
+		return TWI_ADDRESS_NACK;
+	}
+	if (TwoWire::readInto(dst , count) != count) return TWI_TIMEOUT;	// Прочитано не все - был таймаут
+	return TWI_OK;
+}
+
 uint8_t TwoWire::available() 
 {													// Вернуть оставшееся количество запрошенных для чтения байт
 	return _requested_bytes;						// Это содержимое этой переменной
@@ -57,13 +185,21 @@ uint8_t TwoWire::available()
 uint8_t TwoWire::read()
 {						  							// Прямое чтение байта из шины после запроса
 	if (--_requested_bytes) {					    // Если байт не последний 						
+		if (_failed) return 0xFF;					// Транзакция прервана по таймауту
 		TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWEA);	// Запустить чтение шины (с подтверждением "ACK")
-		while (!(TWCR & _BV(TWINT)));				// Дождаться окончания приема данных
+		if (!TwoWire::wait()) return 0xFF;			// Дождаться окончания приема данных
 		return TWDR;								// Вернуть принятые данные , это содержимое data - регистра 
 	}
 	_requested_bytes = 0; 							// Если читаем последний байт
+	if (_failed) {									// Транзакция прервана по таймауту
+		TwoWire::stop();							// Освободить шину для очереди
+		return 0xFF;
+	}
 	TWCR = _BV(TWEN) | _BV(TWINT);					// Запустить чтение шины (БЕЗ подтверждения "NACK")
-	while (!(TWCR & _BV(TWINT)));					// Дождаться окончания приема данных
+	if (!TwoWire::wait()) {							// Дождаться окончания приема данных
+		TwoWire::stop();							// Освободить шину для очереди
+		return 0xFF;
+	}
 	if (_stop_after_request) TwoWire::stop();  		// Если в requestFrom не задан аргумент stop , или stop задан как true - отпустить шину
 	else TwoWire::start();							// Иначе - restart (другой master на шине не сможет влезть между сообщениями)
 	return TWDR;									// Вернуть принятый ранее байт из data - регистра
@@ -77,6 +213,8 @@ void TwoWire::requestFrom(uint8_t address , uint8_t length)
 void TwoWire::requestFrom(uint8_t address , uint8_t length , bool stop) 
 {  													// Запрос n-го кол-ва байт от ведомого устройства (Читайте все байты сразу!!!)
 	_stop_after_request = stop; 					// stop или restart после чтения последнего байта
+	_failed = false;								// Новая транзакция
+	_twbr = TwoWire::clockFor(address);				// Частота этого устройства
 	_requested_bytes = length;						// Записать в переменную количество запрошенных байт
 	TwoWire::start();								// Начать работу на шине
 	TwoWire::write((address << 1) | 0x1);			// Отправить устройству адрес + бит "read" 
@@ -84,13 +222,252 @@ void TwoWire::requestFrom(uint8_t address , uint8_t length , bool stop)
 
 void TwoWire::start()
 {													// сервисная функция с нее начинается любая работа с шиной
+	while (true) {									// Дождаться окончания асинхронной очереди
+		TwoWire::checkTimeout();					// Зависшая асинхронная транзакция не должна держать нас вечно
+		uint8_t sreg = SREG;						// Сохранить состояние прерываний
+		cli();										// Проверка и захват шины - атомарно
+		bool running = _running;					// Шиной владеет прерывание ?
+		if (!running) _blocking = true;				// Нет - шина наша , новые транзакции ждут stop
+		SREG = sreg;								// Вернуть состояние прерываний
+		if (!running) break;
+	}
+	if (_failed) return;							// Транзакция прервана по таймауту
+	TWBR = _twbr;									// Шина наша - переключить частоту
 	TWCR = _BV(TWSTA) | _BV(TWEN) | _BV(TWINT); 	// start + TwoWire enable + установка флага "выполнить задачу"
-	while (!(TWCR & _BV(TWINT)));					// Ожидание завершения 
+	TwoWire::wait();								// Ожидание завершения 
 }
 
 void TwoWire::stop() 
 {													// сервисная функция ей заканчивается работа с шиной
-	TWCR = _BV(TWSTO) | _BV(TWEN) | _BV(TWINT);		// stop + TwoWire enable + установка флага "выполнить задачу"
+	if (!_failed) TWCR = _BV(TWSTO) | _BV(TWEN) | _BV(TWINT);	// stop + TwoWire enable + установка флага "выполнить задачу" , после таймаута stop уже был
+	uint8_t sreg = SREG;							// Сохранить состояние прерываний
+	cli();
+	_blocking = false;								// Шина свободна
+	if (_queue_count && !_running) TwoWire::run();	// Запустить транзакции , поставленные за это время
+	SREG = sreg;									// Вернуть состояние прерываний
+}
+
+bool TwoWire::submit(TwiTransaction *transaction)
+{													// Поставить транзакцию в очередь , работу выполнит прерывание
+	uint8_t sreg = SREG;							// Сохранить состояние прерываний
+	cli();											// Очередь разделяется с прерыванием
+	if (_queue_count == TWI_QUEUE_SIZE) {			// Очередь заполнена
+		SREG = sreg;
+		return false;
+	}
+	uint8_t i = _queue_head + _queue_count;			// Индекс свободного места
+	if (i >= TWI_QUEUE_SIZE) i -= TWI_QUEUE_SIZE;	// Кольцевой буфер
+	transaction->status = TWI_PENDING;				// Транзакция еще не выполнена
+	_queue[i] = transaction;
+	_queue_count++;
+	if (!_running && !_blocking) TwoWire::run();	// Шина свободна - начать сразу
+	SREG = sreg;									// Вернуть состояние прерываний
+	return true;
+}
+
+bool TwoWire::busy(void)
+{													// Есть невыполненные асинхронные транзакции
+	TwoWire::checkTimeout();						// Заодно проверить таймаут текущей транзакции
+	return _queue_count;
+}
+
+void TwoWire::run(void)
+{													// Запуск очереди , вызывается с запрещенными прерываниями
+	_running = true;								// Шиной владеет прерывание
+	_started = micros();							// Отсчет таймаута
+	TWBR = TwoWire::clockFor(_queue[_queue_head]->address);	// Частота первой транзакции
+	while ((TWCR & _BV(TWSTO)) && (!_timeout_us || micros() - _started < _timeout_us));	// Дождаться окончания предыдущего stop
+	TWCR = _BV(TWSTA) | _BV(TWEN) | _BV(TWIE) | _BV(TWINT);	// start , дальше работает прерывание
+}
+
+bool TwoWire::complete(uint8_t status)
+{													// Убрать текущую транзакцию из очереди , вызывается с запрещенными прерываниями
+	TwiTransaction *transaction = _queue[_queue_head];
+	if (++_queue_head == TWI_QUEUE_SIZE) _queue_head = 0;	// Убрать транзакцию из очереди
+	_queue_count--;
+	if (status == TWI_ADDRESS_NACK) _counters.addressNack++;
+	if (status == TWI_DATA_NACK) _counters.dataNack++;
+	if (status == TWI_ERROR) _counters.busError++;
+	if (status == TWI_TIMEOUT) _counters.timeouts++;
+	transaction->status = status;					// Выставить флаг завершения
+	if (transaction->callback) transaction->callback(transaction);	// Callback может поставить новую транзакцию
+	if (_queue_count) {								// Очередь не пуста
+		_started = micros();						// Отсчет таймаута следующей транзакции
+		return true;
+	}
+	_running = false;								// Очередь пуста - освободить шину
+	return false;
+}
+
+void TwoWire::finish(uint8_t status)
+{													// Завершение текущей транзакции , вызывается из прерывания
+	if (TwoWire::complete(status)) {				// Очередь не пуста
+		uint8_t twbr = TwoWire::clockFor(_queue[_queue_head]->address);
+		if (twbr > TWBR) TWBR = twbr;				// stop и start - на меньшей из двух частот , своя выставится после start
+		TWCR = _BV(TWSTO) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE) | _BV(TWINT);	// stop и сразу start следующей транзакции
+	} else {
+		TWCR = _BV(TWSTO) | _BV(TWEN) | _BV(TWINT);	// stop , прерывание выключено
+	}
+}
+
+void TwoWire::checkTimeout(void)
+{													// Таймаут асинхронной транзакции , прерывание по зависшей шине не придет
+	if (!_timeout_us) return;						// Таймаут выключен
+	uint8_t sreg = SREG;							// Сохранить состояние прерываний
+	cli();
+	if (_running) {
+		TwiTransaction *transaction = _queue[_queue_head];
+		uint32_t limit = _timeout_us * (transaction->writeLength + transaction->readLength + 3);	// байты + start , адрес , restart
+		if (micros() - _started > limit) {			// Транзакция зависла
+			_timeout_flag = true;
+			TwoWire::recover();						// Освободить шину , TWI перезапущен
+			if (TwoWire::complete(TWI_TIMEOUT)) {	// Следующая транзакция
+				TWBR = TwoWire::clockFor(_queue[_queue_head]->address);
+				TWCR = _BV(TWSTA) | _BV(TWEN) | _BV(TWIE) | _BV(TWINT);
+			}
+		}
+	}
+	SREG = sreg;									// Вернуть состояние прерываний
+}
+
+bool TwoWire::wait(void)
+{													// Ожидание окончания операции на шине , не дольше _timeout_us
+	uint32_t started = micros();
+	while (!(TWCR & _BV(TWINT))) {
+		if (_timeout_us && micros() - started > _timeout_us) {	// Шина зависла
+			_failed = true;							// Остаток транзакции пропускается
+			_timeout_flag = true;
+			_counters.timeouts++;
+			TwoWire::recover();						// Освободить шину , TWI перезапущен
+			return false;
+		}
+	}
+	return true;
+}
+
+bool TwoWire::recover(void)
+{													// Освобождение шины: ведомый , прерванный посреди байта , держит SDA
+	_counters.recoveries++;
+	TWCR = 0;										// Выключить TWI , ноги SDA и SCL - обычные порты
+	pinMode(SDA, INPUT_PULLUP);						// Отпустить SDA
+	pinMode(SCL, INPUT_PULLUP);						// Отпустить SCL
+	for (uint8_t i = 0; i < 9 && !digitalRead(SDA); i++) {	// До 9 тактов SCL , пока ведомый не отпустит SDA
+		digitalWrite(SCL, LOW);						// SCL в 0
+		pinMode(SCL, OUTPUT);
+		delayMicroseconds(5);
+		pinMode(SCL, INPUT_PULLUP);					// SCL в 1
+		delayMicroseconds(5);
+	}
+	digitalWrite(SCL, LOW);							// stop: SCL в 0 ,
+	pinMode(SCL, OUTPUT);
+	digitalWrite(SDA, LOW);							// SDA в 0 ,
+	pinMode(SDA, OUTPUT);
+	delayMicroseconds(5);
+	pinMode(SCL, INPUT_PULLUP);						// SCL в 1 ,
+	delayMicroseconds(5);
+	pinMode(SDA, INPUT_PULLUP);						// SDA в 1 при SCL = 1
+	delayMicroseconds(5);
+	TWCR = _BV(TWEN);								// Перезапуск TWI , TWBR не меняется
+	return digitalRead(SDA);						// Шина свободна ?
+}
+
+void TwoWire::setWireTimeout(uint32_t timeout)
+{													// Таймаут ожидания одного байта в мкс , 0 - без таймаута
+	_timeout_us = timeout;
+}
+
+bool TwoWire::getWireTimeoutFlag(void)
+{													// Был таймаут с момента последнего сброса флага
+	return _timeout_flag;
+}
+
+void TwoWire::clearWireTimeoutFlag(void)
+{													// Сбросить флаг таймаута
+	_timeout_flag = false;
+}
+
+const TwiCounters &TwoWire::getCounters(void)
+{													// Счетчики ошибок шины
+	return _counters;
+}
+
+void TwoWire::resetCounters(void)
+{													// Обнулить счетчики
+	uint8_t sreg = SREG;							// Счетчики меняет и прерывание
+	cli();
+	_counters = TwiCounters();
+	SREG = sreg;
+}
+
+void TwoWire::onInterrupt(void)
+{													// Шаг асинхронной транзакции по статусу шины
+	if (!_running) {								// Прерывание без очереди
+		TWCR = _BV(TWEN);							// Выключить прерывание
+		return;
+	}
+	TwiTransaction *transaction = _queue[_queue_head];
+	switch (TWSR & 0xF8) {							// Чтение статуса шины
+	case 0x08:										// start
+		_index = 0;
+		TWBR = TwoWire::clockFor(transaction->address);	// Частота этого устройства
+		if (transaction->writeLength || !transaction->readLength) {
+			TWDR = transaction->address << 1;		// Адрес + бит "write"
+		} else {
+			TWDR = (transaction->address << 1) | 0x1;	// Только чтение - адрес + бит "read"
+		}
+		TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT);
+		break;
+	case 0x10:										// restart - переход к чтению
+		TWDR = (transaction->address << 1) | 0x1;	// Адрес + бит "read"
+		TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT);
+		break;
+	case 0x18:										// SLA + W + ACK
+	case 0x28:										// BYTE + ACK
+		if (_index < transaction->writeLength) {	// Есть еще байты для записи
+			TWDR = transaction->writeData[_index++];
+			TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT);
+		} else if (transaction->readLength) {		// Запись окончена , нужно чтение
+			TWCR = _BV(TWSTA) | _BV(TWEN) | _BV(TWIE) | _BV(TWINT);	// restart
+		} else {
+			TwoWire::finish(TWI_OK);
+		}
+		break;
+	case 0x40:										// SLA + R + ACK
+		_index = 0;
+		if (transaction->readLength > 1) {
+			TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT) | _BV(TWEA);	// Чтение с подтверждением "ACK"
+		} else {
+			TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT);	// Единственный байт - "NACK"
+		}
+		break;
+	case 0x50:										// Принят байт , отправлен "ACK"
+		transaction->readData[_index++] = TWDR;
+		if (_index < transaction->readLength - 1) {
+			TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT) | _BV(TWEA);	// Чтение с подтверждением "ACK"
+		} else {
+			TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT);	// Последний байт - "NACK"
+		}
+		break;
+	case 0x58:										// Принят последний байт , отправлен "NACK"
+		transaction->readData[_index] = TWDR;
+		TwoWire::finish(TWI_OK);
+		break;
+	case 0x20:										// SLA + W + NACK
+	case 0x48:										// SLA + R + NACK
+		TwoWire::finish(TWI_ADDRESS_NACK);
+		break;
+	case 0x30:										// BYTE + NACK
+		TwoWire::finish(TWI_DATA_NACK);
+		break;
+	default:										// Потеря арбитража , ошибка шины
+		TwoWire::finish(TWI_ERROR);
+		break;
+	}
+}
+
+ISR(TWI_vect)
+{													// Асинхронные транзакции
+	Wire.onInterrupt();
 }
 
 TwoWire Wire = TwoWire();
\ No newline at end of file
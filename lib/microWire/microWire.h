@@ -13,6 +13,31 @@
 	Функция write сразу отправляет байт на шину , не дожидаясь endTransmission , очереди на отправку нет , отправка занимает некоторое время.
 	Функция read напрямую читает байт из шины, специфика работы с шиной требует читать последний байт в особом порядке , читайте сразу ВСЕ запрошенные байты.
 	Пока не будет прочитан последний байт , шина будет занята. Для чтения всех байт воспользуйтесь конструкцией " for(unt8_t i = 0; Wire.available() ,i++){ data[i] = Wire.read } ".
+	Буферы целиком: write(data , length) и readInto(data , length) , запись и чтение за один вызов - writeThenRead.
+*/
+
+/*
+	Асинхронный режим: транзакция описывается структурой TwiTransaction и ставится в очередь функцией submit.
+	Всю работу с шиной выполняет прерывание TWI_vect , submit возвращается сразу.
+	Транзакция: запись writeLength байт , затем (если readLength != 0) повторный старт и чтение readLength байт в readData.
+	Пока status == TWI_PENDING , структура и буферы должны оставаться на месте!!!
+	Блокирующие функции дожидаются окончания очереди , транзакции , поставленные во время блокирующей работы , стартуют после stop.
+*/
+
+/*
+	Таймауты: каждое ожидание шины ограничено TWI_TIMEOUT_US мкс на байт , асинхронная транзакция - на (байты + 3).
+	По таймауту шина восстанавливается (до 9 тактов SCL , stop , перезапуск TWI) , транзакция завершается с кодом TWI_TIMEOUT.
+	Блокирующая транзакция в худшем случае занимает (байты + 2) * TWI_TIMEOUT_US мкс плюс ~100 мкс на восстановление.
+	Таймаут асинхронной транзакции проверяет busy() , вызывайте ее , пока ждете флаг завершения.
+*/
+
+/*
+	Частота шины задается для каждого устройства: setClock(address , clock) , TWBR переключается перед каждой транзакцией.
+	Устройства без своей частоты работают на частоте setClock(clock) , после begin - 100kHz.
+	calibrate(address , maxClock) перебирает частоты от maxClock вниз и запоминает первую , на которой
+	TWI_CALIBRATION_PROBES раз подряд устройство ответило на адрес и отдало байт. Вызывайте при старте , до асинхронной работы.
+	Запись данных и ее временные требования калибровка НЕ проверяет!!! Для устройств , которым это важно
+	(например , дисплей на PCF8574) , задавайте частоту вручную через setClock(address , clock).
 */
 
 #ifndef microWire_h
@@ -20,18 +45,73 @@
 #include <Arduino.h>
 #include "pins_arduino.h"
 
+#ifndef TWI_QUEUE_SIZE
+#define TWI_QUEUE_SIZE 4							// размер очереди асинхронных транзакций
+#endif
+
+#ifndef TWI_CLOCK_PROFILES
+#define TWI_CLOCK_PROFILES 4						// количество устройств со своей частотой шины
+#endif
+
+#ifndef TWI_CALIBRATION_PROBES
+#define TWI_CALIBRATION_PROBES 16					// проверок на каждой частоте при калибровке
+#endif
+
+#ifndef TWI_TIMEOUT_US
+#define TWI_TIMEOUT_US 1000							// таймаут ожидания одного байта в мкс , 0 - без таймаута
+#endif
+
+#define TWI_OK			0							// транзакция выполнена
+#define TWI_ADDRESS_NACK	2						// нет ответа при передаче адреса
+#define TWI_DATA_NACK	3							// нет ответа при передаче данных
+#define TWI_ERROR		4							// потеря арбитража или ошибка шины
+#define TWI_TIMEOUT		5							// истекло время ожидания , шина восстановлена
+#define TWI_PENDING		0xFF						// транзакция в очереди или выполняется
+
+struct TwiTransaction {
+	uint8_t address;								// адрес устройства (7 бит)
+	const uint8_t *writeData;						// байты для записи
+	uint8_t writeLength;							// количество байт для записи
+	uint8_t *readData;								// буфер для чтения
+	uint8_t readLength;								// количество байт для чтения
+	volatile uint8_t status;						// флаг завершения: TWI_PENDING , затем код результата
+	void (*callback)(TwiTransaction *transaction);	// вызывается из прерывания по завершении , может быть 0
+};
+
+struct TwiCounters {
+	uint16_t addressNack;							// нет ответа при передаче адреса
+	uint16_t dataNack;								// нет ответа при передаче данных
+	uint16_t busError;								// потеря арбитража или ошибка шины
+	uint16_t timeouts;								// истекло время ожидания
+	uint16_t recoveries;							// восстановления шины
+};
+
 class TwoWire {
 public:
 	void begin(void);            				// инициализация шины
 	void setClock(uint32_t clock);       		// ручная установка частоты шины 31-900 kHz (в герцах)
+	void setClock(uint8_t address , uint32_t clock);	// частота шины для одного устройства (в герцах)
+	uint32_t calibrate(uint8_t address , uint32_t maxClock);	// найти и запомнить максимальную надежную частоту устройства , 0 - не отвечает
 	void beginTransmission(uint8_t address); 	// открыть соединение (для записи данных)
 	uint8_t endTransmission(bool stop);  		// закрыть соединение , произвести stop или restart (по умолчанию - stop)
 	uint8_t endTransmission(void);  			// закрыть соединение , произвести stop
 	void write(uint8_t data);                	// отправить в шину байт данных , отправка производится сразу , формат - byte "unsigned char"
+	void write(const uint8_t *data , uint8_t length);	// отправить в шину буфер , останавливается на первом NACK
 	void requestFrom(uint8_t address , uint8_t length , bool stop); //открыть соединение и запросить данные от устройства, отпустить или удержать шину
 	void requestFrom(uint8_t address , uint8_t length);  			//открыть соединение и запросить данные от устройства, отпустить шину
 	uint8_t read(void);                      	// прочитать байт , БУФЕРА НЕТ!!! , читайте сразу все запрошенные байты , stop или restart после чтения последнего байта, настраивается в requestFrom
 	uint8_t available(void);                 	// вернет количество оставшихся для чтения байт
+	uint8_t readInto(uint8_t *data , uint8_t length);	// прочитать запрошенные байты в буфер , вернет количество прочитанных
+	uint8_t writeThenRead(uint8_t address , const uint8_t *data , uint8_t length , uint8_t *dst , uint8_t count);	// записать , restart , прочитать , stop , вернет код ошибки как endTransmission
+	bool submit(TwiTransaction *transaction);	// поставить транзакцию в очередь , false - очередь заполнена
+	bool busy(void);							// есть невыполненные асинхронные транзакции
+	void onInterrupt(void);						// сервисная функция , вызывается из ISR(TWI_vect)
+	void setWireTimeout(uint32_t timeout);		// таймаут ожидания одного байта в мкс , 0 - без таймаута
+	bool getWireTimeoutFlag(void);				// был таймаут с момента последнего сброса флага
+	void clearWireTimeoutFlag(void);			// сбросить флаг таймаута
+	const TwiCounters &getCounters(void);		// счетчики ошибок шины
+	void resetCounters(void);					// обнулить счетчики
+	bool recover(void);							// освободить зависшую шину , true - SDA отпущена
 private:
 	uint8_t _requested_bytes = 0;            	// переменная хранит количество запрошенных и непрочитанных байт
 	bool _address_nack = false;					// Флаг для отслеживания ошибки при передаче адреса
@@ -39,6 +119,29 @@ private:
 	bool _stop_after_request = true;         	// stop или restart после чтения последнего байта
 	void start(void);                        	// сервисная функция с нее начинается любая работа с шиной
 	void stop(void);                         	// сервисная функция ей заканчивается работа с шиной
+	TwiTransaction *_queue[TWI_QUEUE_SIZE];		// очередь асинхронных транзакций
+	volatile uint8_t _queue_head = 0;			// индекс текущей транзакции
+	volatile uint8_t _queue_count = 0;			// количество транзакций в очереди
+	volatile bool _running = false;				// шиной владеет прерывание
+	bool _blocking = false;						// идет блокирующая работа с шиной
+	uint8_t _index = 0;							// позиция в буфере текущей транзакции
+	uint8_t _default_twbr = 72;					// TWBR для устройств без своей частоты
+	uint8_t _twbr = 72;							// TWBR текущей блокирующей транзакции
+	uint8_t _profile_address[TWI_CLOCK_PROFILES];	// адреса устройств со своей частотой
+	uint8_t _profile_twbr[TWI_CLOCK_PROFILES];	// TWBR для этих устройств
+	uint8_t _profiles = 0;						// количество заданных частот
+	uint8_t clockFor(uint8_t address);			// сервисная функция , TWBR для устройства
+	static uint8_t twbrFor(uint32_t clock);		// сервисная функция , расчет TWBR
+	uint32_t _timeout_us = TWI_TIMEOUT_US;		// таймаут ожидания одного байта
+	bool _timeout_flag = false;					// был таймаут
+	bool _failed = false;						// текущая блокирующая транзакция прервана по таймауту
+	volatile uint32_t _started = 0;				// время начала текущей асинхронной транзакции
+	TwiCounters _counters = {0, 0, 0, 0, 0};	// счетчики ошибок
+	bool wait(void);							// сервисная функция , ожидание TWINT с таймаутом
+	void checkTimeout(void);					// сервисная функция , таймаут асинхронной транзакции
+	bool complete(uint8_t status);				// сервисная функция , убрать транзакцию из очереди , true - очередь не пуста
+	void run(void);								// сервисная функция , запуск очереди
+	void finish(uint8_t status);				// сервисная функция , завершение текущей транзакции
 };
 extern TwoWire Wire;
 #endif
\ No newline at end of file
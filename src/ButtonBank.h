@@ -0,0 +1,173 @@
+#ifndef BUTTON_BANK_H
+#define BUTTON_BANK_H
+
+// All buttons on PORTD, sampled together by one PIND read in the TIMER0
+// compare A interrupt (every ~1 ms, next to the millis() overflow one) and
+// debounced with 2 bit vertical counters: a bit toggles after 4 equal
+// samples in a row. Every debounced change goes into a ring buffer with
+// its time, update() replays one change per call, so clicks made while a
+// loop pass stalls are still seen one by one afterwards.
+// The ISR is defined here, include the header from one file only.
+// begin() takes over OCR0A, so PWM on pin 6 (OC0A, analogWrite(6)) is
+// not available while a ButtonBank runs; pin 5 (OC0B) still works.
+
+// timer ticks between two samples, 4 samples make the debounce time
+#ifndef BUTTON_BANK_SAMPLE_TICKS
+#define BUTTON_BANK_SAMPLE_TICKS 5
+#endif
+
+// debounced changes kept for update(), a power of two. A full buffer
+// merges the newest changes, at 16 that takes 7 clicks in one loop pass.
+#ifndef BUTTON_BANK_QUEUE_SIZE
+#define BUTTON_BANK_QUEUE_SIZE 16
+#endif
+#if BUTTON_BANK_QUEUE_SIZE & (BUTTON_BANK_QUEUE_SIZE - 1)
+#error "BUTTON_BANK_QUEUE_SIZE must be a power of two"
+#endif
+
+class ButtonBank {
+  public:
+    // mask: PORTD bits with a button, pressed pulls the pin low
+    ButtonBank(uint8_t mask) {
+      _mask = mask;
+    }
+
+    void begin() {
+      for (byte pin = 0; pin < 8; pin++) {
+        if (_mask & bit(pin)) {
+          pinMode(pin, INPUT);
+        }
+      }
+
+      // buttons already down at startup don't count as pressed
+      _state = ~PIND & _mask;
+      _current = _state;
+      instance() = this;
+
+      // OCR0A is also the pin 6 duty cycle: no analogWrite(6) from here on
+      OCR0A = 0x80;
+      TIMSK0 |= bit(OCIE0A);
+    }
+
+    // called from the timer ISR
+    void sample() {
+      if (++_ticks < BUTTON_BANK_SAMPLE_TICKS) {
+        return;
+      }
+      _ticks = 0;
+
+      uint8_t changed = _state ^ (~PIND & _mask);
+
+      // count down every changed bit, reset the others
+      _count0 = ~(_count0 & changed);
+      _count1 = _count0 ^ (_count1 & changed);
+      changed &= _count0 & _count1;
+
+      if (changed) {
+        _state ^= changed;
+        push(_state);
+      }
+    }
+
+    // Takes the oldest change not seen yet, if any. A button held for
+    // LONG_PRESS_TIME is reported as held once a second and its release
+    // is not a click; pressing or releasing any button restarts the timer.
+    // Holds are only checked once all queued changes are replayed.
+    void update() {
+      unsigned long currentMillis = millis();
+      uint8_t tail = _tail;
+
+      _pressed = 0;
+      _released = 0;
+      _eventTime = currentMillis;
+      if (tail != _head) {
+        uint8_t state = _queueState[tail];
+        _eventTime = _queueTime[tail];
+        _tail = (tail + 1) & (BUTTON_BANK_QUEUE_SIZE - 1);
+
+        _pressed = state & ~_current;
+        _released = _current & ~state;
+        _current = state;
+        _changeTime = _eventTime;
+      }
+
+      _clicked = _released & ~_holdFired;
+      _holdFired &= ~_released;
+      _held = 0;
+
+      if (
+        _current
+        && _tail == _head
+        && currentMillis - _changeTime > LONG_PRESS_TIME
+        && currentMillis - _holdTime > 1000
+      ) {
+        _held = _current;
+        _holdFired |= _current;
+        _holdTime = currentMillis;
+      }
+    }
+
+    uint8_t pressed() { return _pressed; }
+    uint8_t released() { return _released; }
+    uint8_t clicked() { return _clicked; }
+    uint8_t held() { return _held; }
+    uint8_t state() { return _current; }
+    // millis() of the change in pressed()/released(), now without one
+    unsigned long eventTime() { return _eventTime; }
+
+    bool isClicked(uint8_t buttons) { return _clicked & buttons; }
+    bool isHeld(uint8_t buttons) { return _held & buttons; }
+
+    static ButtonBank *&instance() {
+      static ButtonBank *bank = 0;
+      return bank;
+    }
+
+  private:
+    // Single producer: only the ISR moves _head, only update() moves
+    // _tail. The entry is written before _head passes it. A full buffer
+    // overwrites the newest entry, which is never the one update() reads.
+    void push(uint8_t state) {
+      uint8_t head = _head;
+      uint8_t next = (head + 1) & (BUTTON_BANK_QUEUE_SIZE - 1);
+
+      if (next == _tail) {
+        head = (head - 1) & (BUTTON_BANK_QUEUE_SIZE - 1);
+        next = _head;
+      }
+      _queueState[head] = state;
+      _queueTime[head] = millis();
+      _head = next;
+    }
+
+    uint8_t _mask;
+
+    // ISR side
+    uint8_t _state = 0;
+    uint8_t _count0 = 0xFF;
+    uint8_t _count1 = 0xFF;
+    uint8_t _ticks = 0;
+
+    // debounced changes, ISR to update()
+    volatile uint8_t _head = 0;
+    volatile uint8_t _tail = 0;
+    volatile uint8_t _queueState[BUTTON_BANK_QUEUE_SIZE];
+    volatile unsigned long _queueTime[BUTTON_BANK_QUEUE_SIZE];
+
+    // loop side, valid until the next update()
+    unsigned long _changeTime = 0;
+    unsigned long _eventTime = 0;
+    uint8_t _current = 0;
+    uint8_t _pressed = 0;
+    uint8_t _released = 0;
+    uint8_t _clicked = 0;
+    uint8_t _held = 0;
+    uint8_t _holdFired = 0;
+    unsigned long _holdTime = 0;
+};
+
+ISR(TIMER0_COMPA_vect) {
+  ButtonBank::instance()->sample();
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef BUTTON_GESTURES_H
+#define BUTTON_GESTURES_H
+
+#include "ButtonBank.h"
+
+// Gestures built from the ButtonBank edges, call update() right after
+// ButtonBank::update():
+// - double click: a second click of the same button of
+//   setDoubleClickButtons() within GESTURE_DOUBLE_CLICK_TIME, the first one
+//   is still reported as a click, the second one only as the double click.
+//   Other buttons report every click, however fast they come.
+// - chord: two or more buttons down together, reported once when the last
+//   one goes down; releasing them is not a click
+// - repeat: a single button of setRepeatButtons() held for
+//   GESTURE_REPEAT_DELAY repeats, every repeat comes 1/4 sooner down to
+//   GESTURE_REPEAT_MIN_INTERVAL; the release after a repeat is not a
+//   click. Other buttons stay clicks however long they are pressed.
+
+#ifndef GESTURE_DOUBLE_CLICK_TIME
+#define GESTURE_DOUBLE_CLICK_TIME 300
+#endif
+
+#ifndef GESTURE_REPEAT_DELAY
+#define GESTURE_REPEAT_DELAY 500
+#endif
+
+#ifndef GESTURE_REPEAT_INTERVAL
+#define GESTURE_REPEAT_INTERVAL 200
+#endif
+
+#ifndef GESTURE_REPEAT_MIN_INTERVAL
+#define GESTURE_REPEAT_MIN_INTERVAL 30
+#endif
+
+class ButtonGestures {
+  public:
+    ButtonGestures(ButtonBank &bank) {
+      _bank = &bank;
+    }
+
+    // Click pairs are timed by when the edges happened, so a replayed
+    // backlog doesn't turn slow clicks into double clicks
+    void update() {
+      unsigned long currentMillis = millis();
+      unsigned long eventTime = _bank->eventTime();
+      uint8_t pressed = _bank->pressed();
+      uint8_t released = _bank->released();
+      uint8_t state = _bank->state();
+
+      _clicked = _bank->clicked() & ~(_chordFired | _repeatFired);
+      _chordFired &= ~released;
+      _repeatFired &= ~released;
+
+      // double click
+      _doubleClicked = 0;
+      if (_clicked) {
+        if (eventTime - _clickTime <= GESTURE_DOUBLE_CLICK_TIME) {
+          _doubleClicked = _clicked & _lastClicked;
+        }
+        // a third click starts a new pair
+        _lastClicked = _clicked & _doubleClickButtons & ~_doubleClicked;
+        _clickTime = eventTime;
+        _clicked &= ~_doubleClicked;
+      }
+
+      // chord
+      _chord = 0;
+      if (pressed && (state & (state - 1))) {
+        _chord = state;
+        _chordFired |= state;
+      }
+
+      // accelerating repeat
+      _repeated = 0;
+      if (pressed) {
+        _repeatTime = currentMillis;
+        _repeatWait = GESTURE_REPEAT_DELAY;
+        _repeatInterval = GESTURE_REPEAT_INTERVAL;
+      }
+
+      uint8_t repeating = state & _repeatButtons & ~_chordFired;
+      if (
+        repeating
+        && !(repeating & (repeating - 1))
+        && currentMillis - _repeatTime >= _repeatWait
+      ) {
+        _repeated = repeating;
+        _repeatFired |= repeating;
+        _repeatTime = currentMillis;
+        _repeatWait = _repeatInterval;
+
+        _repeatInterval -= _repeatInterval >> 2;
+        if (_repeatInterval < GESTURE_REPEAT_MIN_INTERVAL) {
+          _repeatInterval = GESTURE_REPEAT_MIN_INTERVAL;
+        }
+      }
+    }
+
+    // buttons that repeat while held, none by default
+    void setRepeatButtons(uint8_t buttons) {
+      _repeatButtons = buttons;
+    }
+
+    // buttons that can be double clicked, none by default
+    void setDoubleClickButtons(uint8_t buttons) {
+      _doubleClickButtons = buttons;
+      _lastClicked &= buttons;
+    }
+
+    bool isClicked(uint8_t buttons) { return _clicked & buttons; }
+    bool isDoubleClicked(uint8_t buttons) { return _doubleClicked & buttons; }
+    bool isRepeated(uint8_t buttons) { return _repeated & buttons; }
+    bool isHeld(uint8_t buttons) { return _bank->isHeld(buttons); }
+
+    // true when exactly these buttons formed a chord
+    bool isChord(uint8_t buttons) { return _chord == buttons; }
+
+  private:
+    ButtonBank *_bank;
+    uint8_t _repeatButtons = 0;
+    uint8_t _doubleClickButtons = 0;
+
+    uint8_t _clicked = 0;
+    uint8_t _doubleClicked = 0;
+    uint8_t _chord = 0;
+    uint8_t _repeated = 0;
+
+    uint8_t _lastClicked = 0;
+    unsigned long _clickTime = 0;
+    uint8_t _chordFired = 0;
+    uint8_t _repeatFired = 0;
+    unsigned long _repeatTime = 0;
+    unsigned int _repeatWait = 0;
+    unsigned int _repeatInterval = 0;
+};
+
+#endif
@@ -6,70 +6,119 @@
 class MenuItem;
 class Menu;
 class MenuRenderer;
-class MenuSystem;
+
+// How the focused item is shown in editing mode
+#define EDITING_STYLE_BLINK 0   // the item is cleared and redrawn every 500 ms
+#define EDITING_STYLE_CURSOR 1  // the display blinks its own cursor on the item
+
+// Layout and callbacks of a menu item, kept in PROGMEM
+struct MenuItemLayout {
+  uint8_t x;
+  uint8_t y;
+  uint8_t dynamicTextbufferSize;
+  void (*formatValue)(uint8_t, char*, uint8_t);
+  uint8_t (*updateValue)(uint8_t, bool operationType);
+  int8_t staticMenuTextIndex;
+  uint8_t staticTextbufferSize;
+  bool isFocusable;
+};
+
+// Declares a MenuItem bound to value together with its layout in flash:
+// MENU_ITEM(name, value, x, y, dynamicTextbufferSize, formatValue, updateValue,
+//   staticMenuTextIndex, staticTextbufferSize, isFocusable);
+#define MENU_ITEM(name, value, ...) \
+  const MenuItemLayout name##Layout PROGMEM = { __VA_ARGS__ }; \
+  MenuItem name(value, name##Layout)
 
 class MenuItem {
   public:
     uint8_t *value; 
-    uint8_t x = 0;
-    uint8_t y = 0;
-    uint8_t dynamicTextbufferSize = 0;
-    int staticMenuTextIndex = 0;
-    char* (*formatValue)(uint8_t, uint8_t);
-    uint8_t (*updateValue)(uint8_t, bool operationType);
-    uint8_t staticTextbufferSize = 0;
-    bool isFocusable = 1;
+    MenuItemLayout const *layout;
+    uint8_t renderedValue = 0;
+    bool isRendered = 0;
     
   public:
-    MenuItem(
-      uint8_t &value, 
-      uint8_t x, 
-      uint8_t y, 
-      uint8_t dynamicTextbufferSize,
-      char* (*formatValue)(uint8_t, uint8_t), 
-      uint8_t (*updateValue)(uint8_t, bool operationType),
-      int staticMenuTextIndex = -1,
-      uint8_t staticTextbufferSize = 0,
-      bool isFocusable = 1
-    );
+    MenuItem(uint8_t &value, MenuItemLayout const&layout);
+
+    MenuItemLayout getLayout() const;
 };
 
+// Items live in a PROGMEM table of pointers:
+//   MenuItem* const mainScreenItems[] PROGMEM = { &hours, &minutes };
+//   Menu mainScreen(mainScreenItems);
 class Menu {
   public:
     bool isSelectable;
 
   private:
-    MenuItem **_itemsArray;
+    MenuItem* const *_itemsArray;
     uint8_t _itemsCount = 0;
 
   public:
-    Menu(bool isSelectable = 1);
+    Menu(MenuItem* const *items, uint8_t itemsCount, bool isSelectable);
+
+    template<size_t N>
+    Menu(MenuItem* const (&items)[N], bool isSelectable = 1):
+      Menu(items, N, isSelectable) {};
 
-    void render(MenuRenderer const&renderer) const;
-    void next();
-    bool addItem(MenuItem* menuItem);
+    template<class Renderer>
+    void render(Renderer const&renderer) const {
+      renderer.renderMenu(*this);
+    };
 
     uint8_t getItemsCount() const;
     MenuItem const* getItem(uint8_t i) const;
+    MenuItem* getItem(uint8_t i);
 };
 
+// Dynamic renderer interface. MenuSystem<> dispatches through it, while
+// MenuSystem<SomeRenderer> binds any class with the same methods at compile
+// time, so the render path can be inlined and no vtable is needed.
+class MenuRenderer {
+  public:
+    virtual void renderMenu(Menu const&menu) const = 0;
+    virtual void renderMenuItem(MenuItem const&item) const = 0;
+    virtual void blinkMenuItem(
+      MenuItem const* item,
+      bool itemState
+    ) const = 0;
+    virtual void updateMenuItem(MenuItem const&item) const = 0;
+    virtual void clearScreenArea(MenuItem const&item) const = 0;
+    // puts the blinking display cursor on the item, or removes it
+    virtual void focusMenuItem(MenuItem const&item) const = 0;
+    virtual void unfocusMenuItem() const = 0;
+    virtual void clearScreen() const = 0;
+    // prints a PROGMEM string at x, y and returns its length
+    virtual uint8_t renderStaticText(const char *text, uint8_t x, uint8_t y) const = 0;
+};
+
+template<class Renderer = MenuRenderer>
 class MenuSystem {
   private:
-    MenuRenderer const *_renderer;
-    Menu **_menuArray;
+    Renderer const *_renderer;
+    Menu* const *_menuArray;
     Menu *_activeMenu;
     uint8_t _menusNum = 0;
     bool _isEditingMode = 0;
+    uint8_t _editingStyle = EDITING_STYLE_BLINK;
+    bool _isFullRedraw = 1;
     int _activeMenuNum = 0;
     int _activeFocusItemNum = 0;
     bool _activeFocusItemState = 0;
     unsigned long _activeFocusItemLastBlink = 0;
     unsigned long _lastPressInEditingMode = 0;
 
+    Menu* getMenu(int menuNum);
+
   public:
-    MenuSystem(MenuRenderer const&renderer);
+    MenuSystem(Renderer const&renderer, Menu* const *menus, uint8_t menusNum);
+
+    template<size_t N>
+    MenuSystem(Renderer const&renderer, Menu* const (&menus)[N]):
+      MenuSystem(renderer, menus, N) {};
 
     void display();
+    void refresh();
     void blink();
 
     void nextScreen();
@@ -84,27 +133,220 @@ class MenuSystem {
 
     bool isEditingMode();
     void toggleEditingMode();
+    void setEditingStyle(uint8_t editingStyle);
     void setLastPressInEditingModeToCurrentMillis();
     unsigned long getLastPressInEditingMode();
 
     int getActiveMenuNum();
 
-    bool addMenu(Menu* menu);
-
     void updateMenuItem(MenuItem *item);
 };
 
-class MenuRenderer {
-  public:
-    virtual void renderMenu(Menu const&menu) const = 0;
-    virtual void renderMenuItem(MenuItem const&item) const = 0;
-    virtual void blinkMenuItem(
-      MenuItem const* item,
-      bool itemState
-    ) const = 0;
-    virtual void updateMenuItem(MenuItem const&item) const = 0;
-    virtual void clearScreenArea(MenuItem const&item) const = 0;
-    virtual void clearScreen() const = 0;
+template<class Renderer>
+MenuSystem<Renderer>::MenuSystem(Renderer const&renderer, Menu* const *menus, uint8_t menusNum) {
+  _renderer = &renderer;
+  _menuArray = menus;
+  _menusNum = menusNum;
+  _activeMenu = getMenu(_activeMenuNum);
+};
+
+template<class Renderer>
+Menu* MenuSystem<Renderer>::getMenu(int menuNum) {
+  return (Menu*) pgm_read_word(&(_menuArray[menuNum]));
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::nextScreen() {
+  _activeMenuNum++;
+
+  if(_activeMenuNum > (_menusNum - 1)) {
+    _activeMenuNum = 0;
+  }
+  
+  if((!getMenu(_activeMenuNum)->isSelectable)) {
+    nextScreen();
+  }
+  
+  _activeMenu = getMenu(_activeMenuNum);
+  _renderer->clearScreen();
+  _isFullRedraw = 1;
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::prevScreen() {
+  _activeMenuNum--;
+
+  if(_activeMenuNum < 0) {
+    _activeMenuNum = (_menusNum - 1);
+  }
+
+  if(getMenu(_activeMenuNum)->isSelectable) {
+    _activeMenu = getMenu(_activeMenuNum);
+    _renderer->clearScreen();
+    _isFullRedraw = 1;
+  } else {
+    prevScreen();
+  }
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::setScreen(int screenNum) {
+  _activeMenuNum = screenNum;
+  
+  if(_activeMenuNum > (_menusNum - 1)) {
+    _activeMenuNum = 0;
+  } else if(_activeMenuNum < 0) {
+    _activeMenuNum = (_menusNum - 1);
+  }
+
+  _activeMenu = getMenu(_activeMenuNum);
+  _renderer->clearScreen();
+  _isFullRedraw = 1;
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::nextFocusItem() {
+  resetActiveFocusItem();
+  setLastPressInEditingModeToCurrentMillis();
+  
+  _renderer->renderMenuItem(*(_activeMenu->getItem(_activeFocusItemNum)));
+
+  _activeFocusItemNum++;
+
+  if(_activeFocusItemNum + 1 > _activeMenu->getItemsCount()) {
+    _activeFocusItemNum = 0;
+  }
+
+  MenuItem const* item = _activeMenu->getItem(_activeFocusItemNum);
+  if(item->getLayout().isFocusable == 0) {
+    nextFocusItem();
+  }
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::changeActiveFocusItemValue(bool operationType) {
+  resetActiveFocusItem();
+  setLastPressInEditingModeToCurrentMillis();
+
+  MenuItem const* item = _activeMenu->getItem(_activeFocusItemNum);
+  *(item->value) = item->getLayout().updateValue(*(item->value), operationType);
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::display() {
+  _renderer->renderMenu(*_activeMenu);
+
+  for(uint8_t i = 0; i < _activeMenu->getItemsCount(); i++) {
+    MenuItem *item = _activeMenu->getItem(i);
+    item->renderedValue = *(item->value);
+    item->isRendered = 1;
+  }
+
+  _isFullRedraw = 0;
+};
+
+// Redraws only the items whose value changed since they were last drawn,
+// the whole screen only after it was switched or cleared
+template<class Renderer>
+void MenuSystem<Renderer>::refresh() {
+  if(_isFullRedraw) {
+    display();
+    return;
+  }
+
+  for(uint8_t i = 0; i < _activeMenu->getItemsCount(); i++) {
+    MenuItem *item = _activeMenu->getItem(i);
+
+    if(!item->isRendered || item->renderedValue != *(item->value)) {
+      updateMenuItem(item);
+    }
+  }
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::updateMenuItem(MenuItem *item) {
+  _renderer->updateMenuItem(*item);
+  item->renderedValue = *(item->value);
+  item->isRendered = 1;
+};
+
+template<class Renderer>
+bool MenuSystem<Renderer>::isEditingMode() {
+  return _isEditingMode;
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::toggleEditingMode() {
+  _isEditingMode = !_isEditingMode;
+}
+
+template<class Renderer>
+void MenuSystem<Renderer>::setEditingStyle(uint8_t editingStyle) {
+  _editingStyle = editingStyle;
+}
+
+template<class Renderer>
+void MenuSystem<Renderer>::setLastPressInEditingModeToCurrentMillis() {
+  _lastPressInEditingMode = millis();
+}
+
+template<class Renderer>
+unsigned long MenuSystem<Renderer>::getLastPressInEditingMode() {
+  return _lastPressInEditingMode;
+};
+
+template<class Renderer>
+int MenuSystem<Renderer>::getActiveMenuNum() {
+  return _activeMenuNum;
+}; 
+
+// With EDITING_STYLE_CURSOR the display animates the focus itself, the
+// item is only redrawn after its value changed and the cursor moved back
+template<class Renderer>
+void MenuSystem<Renderer>::blink() {
+  if(_editingStyle == EDITING_STYLE_CURSOR) {
+    MenuItem *item = _activeMenu->getItem(_activeFocusItemNum);
+
+    if(!item->isRendered || item->renderedValue != *(item->value)) {
+      updateMenuItem(item);
+      _activeFocusItemState = 0;
+    }
+
+    if(!_activeFocusItemState) {
+      _renderer->focusMenuItem(*item);
+      _activeFocusItemState = 1;
+    }
+    return;
+  }
+
+  if (millis() - _activeFocusItemLastBlink > 500) {
+    _activeFocusItemState = !_activeFocusItemState;
+    _activeFocusItemLastBlink = millis();
+    
+    _renderer->blinkMenuItem(_activeMenu->getItem(_activeFocusItemNum), _activeFocusItemState);
+  }
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::resetEditingMode() {
+  _isEditingMode = 0;
+  _activeFocusItemNum = 0;
+  _lastPressInEditingMode = 0;
+  // the next editing session has to focus its first item again
+  resetActiveFocusItem();
+
+  if(_editingStyle == EDITING_STYLE_CURSOR) {
+    _renderer->unfocusMenuItem();
+  }
+
+  _renderer->clearScreen();
+  _isFullRedraw = 1;
+};
+
+template<class Renderer>
+void MenuSystem<Renderer>::resetActiveFocusItem() {
+  _activeFocusItemState = 0;
+  _activeFocusItemLastBlink = 0;
 };
 
 #endif
\ No newline at end of file
@@ -4,6 +4,11 @@
 #define CENTRAL_BUTTON_PIN 4
 #define RIGHT_BUTTON_PIN 3
 
+// pins 0..7 are PORTD bits
+#define LEFT_BUTTON bit(LEFT_BUTTON_PIN)
+#define CENTRAL_BUTTON bit(CENTRAL_BUTTON_PIN)
+#define RIGHT_BUTTON bit(RIGHT_BUTTON_PIN)
+
 #define LONG_PRESS_TIME 2000
 #define SHORT_PRESS_TIME 50
 
@@ -19,6 +24,22 @@
 #define ROOM_RELAY_PIN 9
 #define LIVING_ROOM_RELAY_PIN 8
 
+// DS3231 SQW output, INT0
+#define SQW_PIN 2
+// count the seconds of the cached time on the 1 Hz square wave,
+// comment out to extrapolate them from millis()
+#define CLOCK_USE_SQW
+// how long the cached time is used before the RTC is read again, ms
+#define CLOCK_RESYNC_INTERVAL 60000
+// DS3231 temperature conversion time, ms
+#define TEMPERATURE_CONVERSION_TIME 200
+
+#define LCD_ADDRESS 0x27
+// fastest I2C clock tried for the DS3231 at startup, Hz, it is rated for
+// 400 kHz. The LCD is not calibrated: the probe can't check its writes,
+// the driver sets its own clock (LCD_I2C_CLOCK)
+#define RTC_MAX_I2C_CLOCK 400000
+
 #define MAIN_SCREEN_NUM 0
 #define TIMERS_SCREEN_NUM 1
 #define MANUAL_MODE_SCREEN_NUM 2
@@ -33,16 +54,22 @@
 #include <microWire.h>
 #include <microLiquidCrystal_I2C.h>
 
-#include "Button.h"
+#include "ButtonBank.h"
+#include "ButtonGestures.h"
 #include "MenuSystem.h"
 
 DS3231 rtc(SDA, SCL);
 Time time;
-LiquidCrystal_I2C lcd(0x27, 20, 4);
 
-Button leftButton(LEFT_BUTTON_PIN);
-Button centralButton(CENTRAL_BUTTON_PIN);
-Button rightButton(RIGHT_BUTTON_PIN);
+#ifdef CLOCK_USE_SQW
+void onSqwTick() {
+  rtc.tick();
+}
+#endif
+LiquidCrystal_I2C lcd(LCD_ADDRESS, 20, 4);
+
+ButtonBank buttons(LEFT_BUTTON | CENTRAL_BUTTON | RIGHT_BUTTON);
+ButtonGestures gestures(buttons);
 
 // GLOBAl VARIABLES
 // ----------------------------------
@@ -56,7 +83,30 @@ const char* const staticMenuText[STATIC_ELEMENTS_COUNT] PROGMEM = {
   room, delimiter, livingRoom, weekDay, weekend
 };
 
-const char* daysOfTheWeekArr[7] = { "Mon", "Tues",  "Wed", "Thurs", "Fri", "Sat", "Sun" };
+// "00".."99" digit pairs, numeric fields are formatted by a single lookup
+const char twoDigitsTable[] PROGMEM =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+const char monday[4] PROGMEM = "Mon";
+const char tuesday[5] PROGMEM = "Tues";
+const char wednesday[4] PROGMEM = "Wed";
+const char thursday[6] PROGMEM = "Thurs";
+const char friday[4] PROGMEM = "Fri";
+const char saturday[4] PROGMEM = "Sat";
+const char sunday[4] PROGMEM = "Sun";
+
+const char* const daysOfTheWeekArr[7] PROGMEM = {
+  monday, tuesday, wednesday, thursday, friday, saturday, sunday
+};
 
 struct SettingsStruct{
   uint8_t hours = 0;
@@ -87,11 +137,20 @@ bool toggleLivingRoomRelay = 0;
 bool toggleRoomRelay = 0;
 unsigned long toggleRelayTimer = 0;
 
+// minute the RTC alarm flag was last checked in
+uint8_t scheduleCheckMinute = 0xFF;
+
+// room temperature in whole degrees, measured once a minute
+uint8_t roomTemperature = 0;
+uint8_t temperatureMinute = 0xFF;
+bool isTemperatureConverting = 0;
+unsigned long temperatureConversionStart = 0;
+
 // Functions declarations
-char* getStaticMenuItemFromPGM(int staticMenuTextIndex, uint8_t bufferLength);
-char* numToTimeFormat(uint8_t num, uint8_t bufferLength);
-char* numToWeekFormate(uint8_t num, uint8_t bufferLength);
-char* numToOnOffState(uint8_t num, uint8_t bufferLength);
+void numToTimeFormat(uint8_t num, char *buffer, uint8_t bufferLength);
+void numToWeekFormate(uint8_t num, char *buffer, uint8_t bufferLength);
+void numToOnOffState(uint8_t num, char *buffer, uint8_t bufferLength);
+void numToTemperatureFormat(uint8_t num, char *buffer, uint8_t bufferLength);
 
 uint8_t updateHours(uint8_t value, bool operationType);
 uint8_t updateMinutes(uint8_t value, bool operationType);
@@ -100,53 +159,64 @@ uint8_t updateState(uint8_t value, bool operationType);
 
 void updateTime(Time const&time);
 void handleLivingRoomRelay(Time const&time);
+void getLivingRoomSchedule(uint8_t dow, int &onTimeSum, int &offTimeSum);
+void scheduleLivingRoomRelay();
+void checkLivingRoomSchedule();
+void handleTemperature();
 bool isCurrentTimeInInterval(
   int currentTimeSum, 
   int onTimeSum, 
   int offTimeSum
 );
 
-class MainMenuRenderer: public MenuRenderer {
+// Bound to MenuSystem at compile time, implements the MenuRenderer methods
+// without deriving from it
+class MainMenuRenderer {
   public:
-    void renderMenu(Menu const&menu) const override {
+    void renderMenu(Menu const&menu) const {
       for(byte i = 0; i < menu.getItemsCount(); i++) {
         MenuItem const* item = menu.getItem(i);
         renderMenuItem(*item);
       }
     };
 
-    void renderMenuItem(MenuItem const&item) const override {
-      if(item.staticMenuTextIndex >= 0) {
-        renderDynamicMenuItemWithText(item);
+    void renderMenuItem(MenuItem const&item) const {
+      MenuItemLayout const layout = item.getLayout();
+
+      if(layout.staticMenuTextIndex >= 0) {
+        renderDynamicMenuItemWithText(item, layout);
       } else {
-        renderDynamicMenuItem(item);
+        renderDynamicMenuItem(item, layout);
       }
     };
 
-    void renderDynamicMenuItem(MenuItem const&item) const {
-      char *buffer = (*(item.formatValue))(*(item.value), item.dynamicTextbufferSize);
+    void renderDynamicMenuItem(MenuItem const&item, MenuItemLayout const&layout) const {
+      char buffer[layout.dynamicTextbufferSize];
+      (*(layout.formatValue))(*(item.value), buffer, layout.dynamicTextbufferSize);
 
-      lcd.setCursor(item.x, item.y);
+      lcd.setCursor(layout.x, layout.y);
       lcd.print(buffer);
-
-      free(buffer);
     };
 
-    void renderDynamicMenuItemWithText(MenuItem const&item) const {
-      char *dynamicTextBuffer = (*(item.formatValue))(*(item.value), item.dynamicTextbufferSize);
-      char *staticTextBuffer = getStaticMenuItemFromPGM(item.staticMenuTextIndex, item.staticTextbufferSize);
-      
-      lcd.setCursor(item.x, item.y);
-      lcd.print(staticTextBuffer);
-      
-      lcd.setCursor(item.x + strlen(staticTextBuffer), item.y);
+    void renderDynamicMenuItemWithText(MenuItem const&item, MenuItemLayout const&layout) const {
+      char dynamicTextBuffer[layout.dynamicTextbufferSize];
+      (*(layout.formatValue))(*(item.value), dynamicTextBuffer, layout.dynamicTextbufferSize);
+
+      // the value follows the label, the display cursor is already there
+      renderStaticText(
+        (const char*) pgm_read_word(&(staticMenuText[layout.staticMenuTextIndex])),
+        layout.x,
+        layout.y
+      );
       lcd.print(dynamicTextBuffer);
-      
-      free(dynamicTextBuffer);
-      free(staticTextBuffer);
     }
 
-    void updateMenuItem(MenuItem const&item) const override {
+    uint8_t renderStaticText(const char *text, uint8_t x, uint8_t y) const {
+      lcd.setCursor(x, y);
+      return lcd.printPGM(text);
+    }
+
+    void updateMenuItem(MenuItem const&item) const {
       clearScreenArea(item);
       renderMenuItem(item);
     };
@@ -154,7 +224,7 @@ class MainMenuRenderer: public MenuRenderer {
     void blinkMenuItem(
       MenuItem const* item,
       bool itemState
-    ) const override {
+    ) const {
       if (itemState) {
         updateMenuItem(*item);
       } else {
@@ -162,104 +232,106 @@ class MainMenuRenderer: public MenuRenderer {
       }
     };
 
-    void clearScreenArea(MenuItem const&item) const override {
-      char *empty = (char *) malloc(sizeof(char) * item.dynamicTextbufferSize);
-      for (byte i = 0; i < item.dynamicTextbufferSize - 1; i++) {
-        empty[i] = 32;
+    void clearScreenArea(MenuItem const&item) const {
+      MenuItemLayout const layout = item.getLayout();
+
+      lcd.setCursor(valueX(layout), layout.y);
+
+      for (byte i = 0; i < layout.dynamicTextbufferSize - 1; i++) {
+        lcd.write(' ');
       };
+    }; 
 
-      empty[item.dynamicTextbufferSize - 1] = '\0';
+    void focusMenuItem(MenuItem const&item) const {
+      MenuItemLayout const layout = item.getLayout();
 
-      if(item.staticMenuTextIndex >= 0) {
-        lcd.setCursor(item.x + item.staticTextbufferSize - 1, item.y);
-        lcd.print(empty);
-      } else {
-        lcd.setCursor(item.x, item.y);
-        lcd.print(empty);
-      }
+      lcd.setCursor(valueX(layout), layout.y);
+      lcd.blink();
+    };
 
-      free(empty);
-    }; 
+    void unfocusMenuItem() const {
+      lcd.noBlink();
+    };
 
-    void clearScreen() const override {
+    void clearScreen() const {
       lcd.clear();
     }
+
+  private:
+    // column of the value, the label (if any) is printed before it
+    uint8_t valueX(MenuItemLayout const&layout) const {
+      if(layout.staticMenuTextIndex >= 0) {
+        return layout.x + layout.staticTextbufferSize - 1;
+      }
+      return layout.x;
+    };
 };
 
 MainMenuRenderer mainMenuRenderer;
-MenuSystem menuSystem(mainMenuRenderer);
-
-Menu mainScreen;
-Menu timersScreen;
-Menu manualModeScreen(0);
 
 // TODO: EXTRACT NUMBERS TO CONSTANTS
-MenuItem hours(Settings.hours, 0, 0, 3, numToTimeFormat, updateHours);
-MenuItem minutes(Settings.minutes, 2, 0, 3, numToTimeFormat, updateMinutes, 1, 2);
-MenuItem dayOfWeek(Settings.dayOfWeek, 11, 0, 6, numToWeekFormate, updateDayOfWeek);
-MenuItem zalState(Settings.livingRoomState, 0, 1, 4, numToOnOffState, updateState, 2, 5, 0);
-MenuItem roomState(Settings.roomState, 8, 1, 4, numToOnOffState, updateState, 0, 6, 0);
+MENU_ITEM(hours, Settings.hours, 0, 0, 3, numToTimeFormat, updateHours, -1, 0, 1);
+MENU_ITEM(minutes, Settings.minutes, 2, 0, 3, numToTimeFormat, updateMinutes, 1, 2, 1);
+MENU_ITEM(dayOfWeek, Settings.dayOfWeek, 11, 0, 6, numToWeekFormate, updateDayOfWeek, -1, 0, 1);
+MENU_ITEM(zalState, Settings.livingRoomState, 0, 1, 4, numToOnOffState, updateState, 2, 5, 0);
+MENU_ITEM(roomState, Settings.roomState, 8, 1, 4, numToOnOffState, updateState, 0, 6, 0);
+MENU_ITEM(temperature, roomTemperature, 17, 0, 4, numToTemperatureFormat, 0, -1, 0, 0);
+
+MENU_ITEM(wekdOnHours, Settings.wekdOnHours, 0, 0, 3, numToTimeFormat, updateHours, 3, 6, 1);
+MENU_ITEM(wekdOnMinutes, Settings.wekdOnMinutes, 7, 0, 3, numToTimeFormat, updateMinutes, 1, 2, 1);
+MENU_ITEM(wekdOffHours, Settings.wekdOffHours, 11, 0, 3, numToTimeFormat, updateHours, -1, 0, 1);
+MENU_ITEM(wekdOffMinutes, Settings.wekdOffMinutes, 13, 0, 3, numToTimeFormat, updateMinutes, 1, 2, 1);
+
+MENU_ITEM(wkndOnHours, Settings.wkndOnHours, 0, 1, 3, numToTimeFormat, updateHours, 4, 6, 1);
+MENU_ITEM(wkndOnMinutes, Settings.wkndOnMinutes, 7, 1, 3, numToTimeFormat, updateMinutes, 1, 2, 1);
+MENU_ITEM(wkndOffHours, Settings.wkndOffHours, 11, 1, 3, numToTimeFormat, updateHours, -1, 0, 1);
+MENU_ITEM(wkndOffMinutes, Settings.wkndOffMinutes, 13, 1, 3, numToTimeFormat, updateMinutes, 1, 2, 1);
+
+MENU_ITEM(selectableZalState, Settings.livingRoomState, 0, 0, 4, numToOnOffState, updateState, 2, 5, 1);
+MENU_ITEM(selectableRoomState, Settings.roomState, 0, 1, 4, numToOnOffState, updateState, 0, 6, 1);
+
+MenuItem* const mainScreenItems[] PROGMEM = {
+  &hours, &minutes, &dayOfWeek, &zalState, &roomState, &temperature
+};
+MenuItem* const timersScreenItems[] PROGMEM = {
+  &wekdOnHours, &wekdOnMinutes, &wekdOffHours, &wekdOffMinutes,
+  &wkndOnHours, &wkndOnMinutes, &wkndOffHours, &wkndOffMinutes
+};
+MenuItem* const manualModeScreenItems[] PROGMEM = {
+  &selectableZalState, &selectableRoomState
+};
 
-MenuItem wekdOnHours(Settings.wekdOnHours, 0, 0, 3, numToTimeFormat, updateHours, 3, 6);
-MenuItem wekdOnMinutes(Settings.wekdOnMinutes, 7, 0, 3, numToTimeFormat, updateMinutes, 1, 2);
-MenuItem wekdOffHours(Settings.wekdOffHours, 11, 0, 3, numToTimeFormat, updateHours);
-MenuItem wekdOffMinutes(Settings.wekdOffMinutes, 13, 0, 3, numToTimeFormat, updateMinutes, 1, 2);
+Menu mainScreen(mainScreenItems);
+Menu timersScreen(timersScreenItems);
+Menu manualModeScreen(manualModeScreenItems, 0);
 
-MenuItem wkndOnHours(Settings.wkndOnHours, 0, 1, 3, numToTimeFormat, updateHours, 4, 6);
-MenuItem wkndOnMinutes(Settings.wkndOnMinutes, 7, 1, 3, numToTimeFormat, updateMinutes, 1, 2);
-MenuItem wkndOffHours(Settings.wkndOffHours, 11, 1, 3, numToTimeFormat, updateHours);
-MenuItem wkndOffMinutes(Settings.wkndOffMinutes, 13, 1, 3, numToTimeFormat, updateMinutes, 1, 2);
+Menu* const menus[] PROGMEM = {
+  &mainScreen, &timersScreen, &manualModeScreen
+};
 
-MenuItem selectableZalState(Settings.livingRoomState, 0, 0, 4, numToOnOffState, updateState, 2, 5);
-MenuItem selectableRoomState(Settings.roomState, 0, 1, 4, numToOnOffState, updateState, 0, 6);
+MenuSystem<MainMenuRenderer> menuSystem(mainMenuRenderer, menus);
 
 // FUNCTIONS
 // ----------------------------------
-char* getStaticMenuItemFromPGM(int staticMenuTextIndex, uint8_t bufferLength) {
-  uint16_t ptr = pgm_read_word(&(staticMenuText[staticMenuTextIndex]));
-  uint8_t i = 0;
-
-  char *buffer = (char *) malloc(sizeof(char) * bufferLength);
-  do {
-    buffer[i] = (char)(pgm_read_byte(ptr++));
-  } while (buffer[i++] != NULL);
-  buffer[bufferLength - 1] = '\0';
-
-  return buffer;
-}
+// Formatters write into a caller-provided buffer of bufferLength bytes
 
-char* numToTimeFormat(uint8_t num, uint8_t bufferLength) {
-  char *buffer = (char *) malloc(sizeof(char) * bufferLength);
-  {
-    String str = "";
-
-    if(num < 10) {
-      str += "0";
-    }
-
-    str += num;
-    str.toCharArray(buffer, bufferLength);
+void numToTimeFormat(uint8_t num, char *buffer, uint8_t bufferLength) {
+  if(num > 99) {
+    buffer[0] = '-';
+    buffer[1] = '-';
+  } else {
+    buffer[0] = pgm_read_byte(&twoDigitsTable[num * 2]);
+    buffer[1] = pgm_read_byte(&twoDigitsTable[num * 2 + 1]);
   }
   buffer[bufferLength - 1] = '\0';
-
-  return buffer;
 }
-char* numToWeekFormate(uint8_t num, uint8_t bufferLength) {
-  char *buffer = (char *) malloc(sizeof(char) * bufferLength);
-  const char* dOW = daysOfTheWeekArr[num];
-  uint8_t i = 0;
-
-  do
-  {
-    buffer[i] = dOW[i];
-  } while (buffer[i++] != NULL);
-  buffer[bufferLength - 1] = '\0';
+void numToWeekFormate(uint8_t num, char *buffer, uint8_t bufferLength) {
+  const char* dOW = (const char*) pgm_read_word(&(daysOfTheWeekArr[num]));
 
-  return buffer;
+  strncpy_P(buffer, dOW, bufferLength - 1);
+  buffer[bufferLength - 1] = '\0';
 }
-char* numToOnOffState(uint8_t num, uint8_t bufferLength) {
-  char *buffer = (char *) malloc(sizeof(char) * bufferLength);
-  
+void numToOnOffState(uint8_t num, char *buffer, uint8_t bufferLength) {
   if(num == 0) {
     buffer[0] = 'o';
     buffer[1] = 'f';
@@ -275,8 +347,10 @@ char* numToOnOffState(uint8_t num, uint8_t bufferLength) {
     buffer[2] = 'r';
     buffer[3] = '\0';
   }
- 
-  return buffer;
+}
+void numToTemperatureFormat(uint8_t num, char *buffer, uint8_t bufferLength) {
+  numToTimeFormat(num, buffer, bufferLength);
+  buffer[2] = 'C';
 }
 
 uint8_t updateHours(uint8_t value, bool operationType) {
@@ -367,34 +441,107 @@ void initializeSettings() {
   
   EEPROM.get(0, Settings);
 
-  time = rtc.getTime();
+  time = rtc.getCachedTime();
   Settings.dayOfWeek = time.dow - 1;
   Settings.hours = time.hour;
   Settings.minutes = time.min;
 };
 void saveSettings() {
   EEPROM.put(0, Settings);
-  rtc.setTime(Settings.hours, Settings.minutes, 0);
-  rtc.setDOW(Settings.dayOfWeek + 1);
+
+  // one transaction, the date registers are not touched
+  rtc.setTime(Settings.hours, Settings.minutes, 0, Settings.dayOfWeek + 1);
+
+  time = rtc.getCachedTime();
+  scheduleLivingRoomRelay();
 };
 
 void updateTime(Time const&time) {
   if(time.sec == 0 && Settings.minutes != time.min) {
     Settings.minutes = time.min;
-
-    if(menuSystem.getActiveMenuNum() == MAIN_SCREEN_NUM) {
-      menuSystem.updateMenuItem(&minutes);
-    }
   }
        
   if(time.sec == 0 && time.min == 0 && Settings.hours != time.hour) {
     Settings.hours = time.hour;
     Settings.dayOfWeek = time.dow - 1;
+  }
+};
+
+void getLivingRoomSchedule(uint8_t dow, int &onTimeSum, int &offTimeSum) {
+  if(dow == 6 || dow == 7) {
+    onTimeSum = Settings.wkndOnHours * 60 + Settings.wkndOnMinutes;
+    offTimeSum = Settings.wkndOffHours * 60 + Settings.wkndOffMinutes;
+  } else {
+    onTimeSum = Settings.wekdOnHours * 60 + Settings.wekdOnMinutes;
+    offTimeSum = Settings.wekdOffHours * 60 + Settings.wekdOffMinutes;
+  }
+};
+
+// Evaluates the schedule now (in automatic mode) and loads the next on/off
+// time into RTC Alarm 2. Midnight is always a candidate, the weekday and
+// weekend schedules switch there.
+void scheduleLivingRoomRelay() {
+  if(!Settings.isManualMode) {
+    handleLivingRoomRelay(time);
+  }
+
+  int onTimeSum;
+  int offTimeSum;
+  int currentTimeSum = time.hour * 60 + time.min;
+  int nextTimeSum = 24 * 60;
+  uint8_t nextDow = time.dow;
+
+  getLivingRoomSchedule(time.dow, onTimeSum, offTimeSum);
 
-    if(menuSystem.getActiveMenuNum() == MAIN_SCREEN_NUM) {
-      menuSystem.updateMenuItem(&hours);
-      menuSystem.updateMenuItem(&dayOfWeek);
+  if(onTimeSum != offTimeSum) {
+    if(onTimeSum > currentTimeSum && onTimeSum < nextTimeSum) {
+      nextTimeSum = onTimeSum;
     }
+    if(offTimeSum > currentTimeSum && offTimeSum < nextTimeSum) {
+      nextTimeSum = offTimeSum;
+    }
+  }
+
+  if(nextTimeSum == 24 * 60) {
+    nextTimeSum = 0;
+    nextDow = nextDow % 7 + 1;
+  }
+
+  rtc.setAlarm2(nextDow, nextTimeSum / 60, nextTimeSum % 60, ALARM_MATCH_DOW);
+  rtc.checkAlarm(ALARM_2);
+  scheduleCheckMinute = time.min;
+};
+
+// The INT/SQW pin carries the clock ticks, so the alarm flag is polled,
+// once a minute
+void checkLivingRoomSchedule() {
+  if(time.min == scheduleCheckMinute) {
+    return;
+  }
+  scheduleCheckMinute = time.min;
+
+  if(rtc.checkAlarm(ALARM_2)) {
+    scheduleLivingRoomRelay();
+  }
+};
+
+// Starts a conversion in the RTC once a minute and reads the result after
+// it had time to finish, the displayed value is the filtered average
+void handleTemperature() {
+  if(isTemperatureConverting) {
+    if(
+      millis() - temperatureConversionStart > TEMPERATURE_CONVERSION_TIME &&
+      rtc.isTempReady()
+    ) {
+      rtc.getTempFixed();
+      int16_t average = rtc.getTempAverage();
+      roomTemperature = average > 0 ? (average + 2) >> 2 : 0;
+      isTemperatureConverting = 0;
+    }
+  } else if(time.min != temperatureMinute) {
+    temperatureMinute = time.min;
+    isTemperatureConverting = rtc.startTempConversion();
+    temperatureConversionStart = millis();
   }
 };
 
@@ -403,13 +550,7 @@ void handleLivingRoomRelay(Time const&time) {
   int offTimeSum;
   int currentTimeSum = time.hour * 60 + time.min;
 
-  if(time.dow == 6 || time.dow == 7) {
-    onTimeSum = Settings.wkndOnHours * 60 + Settings.wkndOnMinutes;
-    offTimeSum = Settings.wkndOffHours * 60 + Settings.wkndOffMinutes;
-  } else {
-    onTimeSum = Settings.wekdOnHours * 60 + Settings.wekdOnMinutes;
-    offTimeSum = Settings.wekdOffHours * 60 + Settings.wekdOffMinutes;
-  }
+  getLivingRoomSchedule(time.dow, onTimeSum, offTimeSum);
   
   if(onTimeSum < offTimeSum) {
     if(
@@ -489,8 +630,6 @@ void toggleRelays() {
 
       Settings.livingRoomRelayState = !Settings.livingRoomRelayState;
       Settings.livingRoomState = Settings.livingRoomRelayState;
-
-      menuSystem.updateMenuItem(&zalState);
     } 
     if(toggleRoomRelay) {
       digitalWrite(ROOM_RELAY_PIN, LOW);
@@ -501,11 +640,6 @@ void toggleRelays() {
     }
 
     saveSettings();
-
-    if(menuSystem.getActiveMenuNum() == MAIN_SCREEN_NUM) {
-      menuSystem.updateMenuItem(&roomState);
-      menuSystem.updateMenuItem(&zalState);
-    }
   } else if(millis() - toggleRelayTimer > 10500) {
     digitalWrite(POWER_RELAY_PIN, LOW);
   } else if(millis() - toggleRelayTimer > 500) {
@@ -521,40 +655,34 @@ void setup() {
   Serial.begin(9600);
 
   rtc.begin();
-
-  lcd.init();
+  rtc.setCacheInterval(CLOCK_RESYNC_INTERVAL);
+
+#ifdef CLOCK_USE_SQW
+  rtc.setSQWRate(SQW_RATE_1);
+  rtc.setOutput(OUTPUT_SQW);
+  pinMode(SQW_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(SQW_PIN), onSqwTick, FALLING);
+  rtc.useSQWTicks(true);
+#endif
+
+  lcd.asyncOn();
+  lcd.initFast();
   lcd.backlight();
-  lcd.clear();
-
-  initializeSettings();
+  lcd.bufferOn();
 
-  mainScreen.addItem(&hours);
-  mainScreen.addItem(&minutes);
-  mainScreen.addItem(&dayOfWeek);
-  mainScreen.addItem(&zalState);
-  mainScreen.addItem(&roomState);
+  Wire.calibrate(DS3231_ADDR, RTC_MAX_I2C_CLOCK);
 
-  timersScreen.addItem(&wekdOnHours);
-  timersScreen.addItem(&wekdOnMinutes);
-  timersScreen.addItem(&wekdOffHours);
-  timersScreen.addItem(&wekdOffMinutes);
-
-  timersScreen.addItem(&wkndOnHours);
-  timersScreen.addItem(&wkndOnMinutes);
-  timersScreen.addItem(&wkndOffHours);
-  timersScreen.addItem(&wkndOffMinutes);
-
-  manualModeScreen.addItem(&selectableZalState);
-  manualModeScreen.addItem(&selectableRoomState);
+  initializeSettings();
+  scheduleLivingRoomRelay();
 
-  menuSystem.addMenu(&mainScreen);
-  menuSystem.addMenu(&timersScreen);
-  menuSystem.addMenu(&manualModeScreen);
+  menuSystem.setEditingStyle(EDITING_STYLE_CURSOR);
 
   if(Settings.isManualMode) {
     menuSystem.setScreen(MANUAL_MODE_SCREEN_NUM);
   }
 
+  buttons.begin();
+
   pinMode(POWER_RELAY_PIN, OUTPUT);
   pinMode(LIVING_ROOM_RELAY_PIN, OUTPUT);
   pinMode(ROOM_RELAY_PIN, OUTPUT);
@@ -574,11 +702,22 @@ void setup() {
 void loop() {
   // Serial.println(memoryFree());
 
+  buttons.update();
+  // only the value buttons repeat, and only while editing
+  gestures.setRepeatButtons(
+    menuSystem.isEditingMode() ? LEFT_BUTTON | RIGHT_BUTTON : 0
+  );
+  // a double click enters editing mode, inside it every click counts
+  gestures.setDoubleClickButtons(
+    menuSystem.isEditingMode() ? 0 : CENTRAL_BUTTON
+  );
+  gestures.update();
+
   if(isToggleRelays()) {
     toggleRelays();
   }
 
-  if(centralButton.isHeld()) {
+  if(gestures.isHeld(CENTRAL_BUTTON)) {
     menuSystem.toggleEditingMode();
     menuSystem.setLastPressInEditingModeToCurrentMillis();
     
@@ -586,12 +725,14 @@ void loop() {
       menuSystem.resetEditingMode();
       saveSettings();
     }
+  } else if(!menuSystem.isEditingMode() && gestures.isDoubleClicked(CENTRAL_BUTTON)) {
+    menuSystem.toggleEditingMode();
+    menuSystem.setLastPressInEditingModeToCurrentMillis();
   }
 
   if(
     !menuSystem.isEditingMode() && 
-    (leftButton.isHeld() || 
-    rightButton.isHeld())
+    gestures.isChord(LEFT_BUTTON | RIGHT_BUTTON)
   ) {
     Settings.isManualMode = !Settings.isManualMode;
     saveSettings();
@@ -603,11 +744,11 @@ void loop() {
   }
 
   if(menuSystem.isEditingMode()) {
-    if(centralButton.isClicked()) {
+    if(gestures.isClicked(CENTRAL_BUTTON)) {
       menuSystem.nextFocusItem();
-    } else if(leftButton.isClicked() || leftButton.isHeld()) {
+    } else if(gestures.isClicked(LEFT_BUTTON) || gestures.isRepeated(LEFT_BUTTON)) {
       menuSystem.changeActiveFocusItemValue(UPDATE_DECREMENT);
-    } else if(rightButton.isClicked() || rightButton.isHeld()) {
+    } else if(gestures.isClicked(RIGHT_BUTTON) || gestures.isRepeated(RIGHT_BUTTON)) {
       menuSystem.changeActiveFocusItemValue(UPDATE_INCREMENT);
     } else {
       menuSystem.blink();
@@ -619,18 +760,19 @@ void loop() {
       initializeSettings();
     }
   } else if(!menuSystem.isEditingMode() && !Settings.isManualMode) {
-    if(leftButton.isClicked()) {
+    if(gestures.isClicked(LEFT_BUTTON)) {
       menuSystem.prevScreen();
     }
-    if(rightButton.isClicked()) {
+    if(gestures.isClicked(RIGHT_BUTTON)) {
       menuSystem.nextScreen();
     }
     
-    time = rtc.getTime();
+    time = rtc.getCachedTime();
     updateTime(time);
-    handleLivingRoomRelay(time);
+    checkLivingRoomSchedule();
+    handleTemperature();
 
-    menuSystem.display();
+    menuSystem.refresh();
   } else if(!menuSystem.isEditingMode() && Settings.isManualMode) {
     if(Settings.livingRoomRelayState != Settings.livingRoomState) {
       toggleLivingRoomRelay = 1;
@@ -640,6 +782,9 @@ void loop() {
       toggleRoomRelay = 1;
     }
 
-    menuSystem.display();
+    menuSystem.refresh();
   }
+
+  lcd.flush();
+  lcd.pump();
 }
\ No newline at end of file